@@ -49,17 +49,57 @@ typedef struct {
 								///  flatone
 } ac_bldg_t;
 
-/// Prop tree node structure.
-typedef struct ac_prop_s {
-	ac_vec4_t			bounds[2];	///< 2 points describing the AABB (axis-
-									///  aligned bounding box) of the node
-	struct ac_prop_s	*child[4];	///< pointers to children nodes
-	ac_tree_t			*trees;		///< tree array (NULL if node is a
-									///  branch or a building prop leaf)
-	ac_bldg_t			*bldgs;		///< building array (NULL if node is a
-									///  branch or a tree prop leaf)
+/// Prop tree node type enumeration.
+typedef enum {
+	PROP_BRANCH,			///< inner node
+	PROP_TREES,				///< tree prop leaf
+	PROP_BLDGS				///< building prop leaf
+} ac_prop_type_t;
+
+/// \brief Prop tree node structure.
+/// All the nodes live in a single array, root first. The children of a node
+/// are stored next to each other and followed by their own subtrees, all in
+/// Morton (Z) order of the quadrants, so a depth-first traversal walks the
+/// array mostly forward. The horizontal extents of a node's AABB (axis-aligned
+/// bounding box) follow from its position in the tree, so only the vertical
+/// ones are stored (see \ref gen_prop_bounds).
+typedef struct {
+	float		bounds[2];	///< bottom and top of the AABB
+	int			first;		///< index of the first child node for branches,
+							///  index of the first prop in the tree or
+							///  building list for leaves
+	uchar		children;	///< bit mask of the existing children; bit i
+							///  stands for the child in quadrant i (X in bit
+							///  0, Z in bit 1), 0 for leaves
+	uchar		type;		///< \ref ac_prop_type_t
+	uchar		count;		///< number of props for leaves, 0 for branches
 } ac_prop_t;
 
+/// \brief Building collision table.
+/// Everything the collision code needs to know about the buildings, in
+/// structure-of-arrays layout: element i of every array belongs to building i
+/// of \ref gen_bldgs. The buildings are also binned into a uniform grid over
+/// the world, every cell listing those whose collision boxes overlap it, for
+/// traces to walk through cell by cell.
+typedef struct {
+	float		*x, *y, *z;		///< centres of the collision boxes; only the
+								///  vertical one differs from the origin of
+								///  the building
+	float		*c, *s;			///< cosines and sines of the orientations;
+								///  they make up the inverse rotations
+	float		*hx, *hy, *hz;	///< half extents of the collision boxes, the
+								///  vertical one scaled like the model and
+								///  including the ridge of a slanted roof
+	int			cellShift;		///< log2 of the grid cell width in metres
+	int			cellSide;		///< number of grid cells per side
+	int			*cellStart;		///< first entry of every cell in cellBldgs,
+								///  followed by the total count
+	int			*cellBldgs;		///< building indices of all the cells
+	float		*cellTop;		///< highest point of any collision box in
+								///  every cell
+	float		top;			///< highest point of any collision box
+} ac_bldg_coll_t;
+
 /// Viewpoint definition structure.
 typedef struct {
 	ac_vec4_t	origin;		///< camera position
@@ -114,6 +154,9 @@ extern bool m_compatshader;
 /// force-feedback rumble intensity
 extern float m_rumble_intensity;
 
+/// random seed of the game world
+extern int m_seed;
+
 /// @}
 
 // =========================================================
@@ -124,12 +167,29 @@ extern float m_rumble_intensity;
 
 /// \brief size of terrain height map
 /// (in pixels; 1 pixel translates to 1 square metre in game world)
-#define HEIGHTMAP_SIZE		1024
+/// \note				This is not a constant; the size is selected at
+///						startup by the -s <size> commandline option (see
+///						\ref gen_set_heightmap_size)
+#define HEIGHTMAP_SIZE		gen_heightmap_size
+/// \brief default \ref HEIGHTMAP_SIZE
+#define DEFAULT_HEIGHTMAP_SIZE	1024
+/// \brief smallest allowed \ref HEIGHTMAP_SIZE
+#define MIN_HEIGHTMAP_SIZE	256
+/// \brief largest allowed \ref HEIGHTMAP_SIZE
+#define MAX_HEIGHTMAP_SIZE	16384
+/// \brief default terrain memory budget in bytes
+/// Heightmaps larger than the budget are streamed in chunks (see
+/// \ref gen_set_terrain_budget).
+#define DEFAULT_TERRAIN_BUDGET	(64 << 20)
 /// \brief height amplitude in metres
 #define HEIGHT				50.f
 /// \brief height scaling factor
 /// used when converting from heightmap bytes to game world height
 #define HEIGHT_SCALE		(HEIGHT / 255.f)
+/// \brief bit shift to apply when operating on the height range pyramid;
+/// 2^3 = 8, which means that a base cell of the pyramid covers an 8*8 square of
+/// the height map (see \ref gen_height_range)
+#define HEIGHT_RANGE_SHIFT	3
 
 /// \brief number of vertices in the base of the tree
 /// at the highest level of detail
@@ -155,10 +215,16 @@ extern float m_rumble_intensity;
 #define TREE_COVERAGE		0.6
 /// \brief fraction of the entire terrain's surf. area to be used by buildings
 #define BLDG_COVERAGE		0.08
-/// \brief number of trees to plant per prop map square
+/// \brief maximum number of trees to plant per prop map square
 #define TREES_PER_FIELD		25
-/// \brief number of buildings to plant per prop map square
+/// \brief maximum number of buildings to plant per prop map square
 #define BLDGS_PER_FIELD		1
+/// \brief minimum distance between trees in metres
+/// (the trees are scattered using Poisson disc sampling, so they don't overlap
+/// and as many of them fit in a prop map square as the spacing allows)
+#define TREE_SPACING		3.f
+/// \brief minimum distance between buildings in metres
+#define BLDG_SPACING		8.f
 /// \brief maximum number of props (either trees or buildings) per prop map square
 #define PROPS_PER_FIELD		(TREES_PER_FIELD > BLDGS_PER_FIELD				\
 								? TREES_PER_FIELD : BLDGS_PER_FIELD)
@@ -173,19 +239,241 @@ extern float m_rumble_intensity;
 /// \brief dimension of the special effects texture (both width and height)
 #define FX_TEXTURE_SIZE		256
 
-/// \brief heightmap byte array
-extern uchar				gen_heightmap[];
-/// \brief root of the prop tree
+/// \brief current heightmap size; use \ref HEIGHTMAP_SIZE instead
+extern int					gen_heightmap_size;
+/// \brief heightmap byte array; NULL until \ref gen_terrain is called, as well
+/// as when the heightmap is streamed (use \ref gen_height instead)
+extern uchar				*gen_heightmap;
+/// \brief prop tree node array, root first; NULL if there are no props
 extern ac_prop_t			*gen_proptree;
+/// \brief tree list the prop tree leaves refer to (see \ref gen_proplists)
+extern ac_tree_t			*gen_trees;
+/// \brief building list the prop tree leaves refer to
+extern ac_bldg_t			*gen_bldgs;
+/// \brief collision table of \ref gen_bldgs, built by \ref gen_proplists
+extern ac_bldg_coll_t		gen_bldg_coll;
+
+/// \brief Sets the size of the game world.
+/// Must be called before \ref gen_open_world. All the world-dependent sizes
+/// (\ref PROPMAP_SIZE, \ref MAX_NUM_TREES etc.) follow.
+/// \param size			new \ref HEIGHTMAP_SIZE; must be a power of 2 between
+///						\ref MIN_HEIGHTMAP_SIZE and \ref MAX_HEIGHTMAP_SIZE
+/// \return				true on success, false if the size is invalid or a
+///						world is already loaded
+bool gen_set_heightmap_size(int size);
+
+/// \brief Sets the memory budget of the terrain heightmap.
+/// Heightmaps that don't fit in the budget are streamed in chunks, generated in
+/// the background around the point of interest (see \ref gen_stream_update).
+/// Must be called before \ref gen_terrain.
+/// \param bytes		maximum size of the resident heightmap in bytes
+void gen_set_terrain_budget(size_t bytes);
+
+/// \brief Selects the random number generator used for the game world.
+/// The terrain and the clouds always come from the single sequence older
+/// versions of the game drew all their numbers from, so they stay the same
+/// for every seed. By default, the prop stages draw theirs from a
+/// counter-based generator keyed by the seed, the stage and the cell being
+/// generated, which places different props than older versions did, the
+/// default 0xDEADBEEF world included. The legacy mode draws them from the
+/// single sequence, too, reproducing the props of older versions, all but the
+/// heights of those along the far Z edge of the map, which older versions
+/// read from past the end of the heightmap.
+/// Must be called before \ref gen_open_world.
+/// \param legacy		true to select the legacy generator
+void gen_set_legacy_rng(bool legacy);
+
+/// \brief Enables or disables packing of the world cache sections.
+/// Packed sections take a fraction of the disk space, which suits archiving
+/// the worlds, but have to be unpacked into memory on every load, which takes
+/// longer than mapping the raw ones; a packed heightmap can't be streamed
+/// straight from the cache file either. Files of either kind can be read
+/// regardless of the setting. Disabled by default.
+/// \param pack			true to pack the large sections of the world caches
+void gen_set_cache_packing(bool pack);
+
+/// \brief Enables or disables the world and asset cache files altogether.
+/// With the caches disabled, everything is generated anew and nothing is
+/// written to disk, e.g. for benchmarking the generator. Closes the currently
+/// open cache files, so it should be called before \ref gen_open_world.
+/// Enabled by default.
+/// \param enable		false to neither read nor write any cache files
+void gen_set_caching(bool enable);
+
+/// \brief Selects the game world to generate.
+/// Maps the world's cache file, if there is a valid one, so that the generator
+/// functions may load their results from it instead of generating them anew.
+/// Should be called before any other generator function.
+/// \param seed			random number seed of the world
+void gen_open_world(int seed);
+
+/// \brief Stores everything generated since \ref gen_open_world in the world's
+/// cache file, and the assets shared by all worlds in the asset cache file.
+/// Does nothing if all of the world has been loaded from the cache.
+void gen_save_world(void);
+
+/// \brief Tells how many times generating the world is going to call
+/// \ref g_loading_tick.
+/// Only counts the stages that actually need generating, given what's in the
+/// cache files; must be called after \ref gen_open_world.
+int gen_load_ticks(void);
+
+/// \brief Returns the peak size of the generator's scratch memory.
+/// The temporary buffers of all the generator stages come from a single arena,
+/// released in one go at the end of every stage.
+/// \return				peak size of the arena in bytes since the last call
+///						to \ref gen_open_world
+size_t gen_scratch_peak(void);
+
+/// \brief Checks the vectorized noise kernels against the scalar one.
+/// The check is only run once; subsequent calls return the cached result.
+/// \return				true if all the kernels produced bit-identical results
+bool gen_perlin_check(void);
+
+/// \brief Scheduling priorities of the world pool.
+typedef enum {
+	GEN_POOL_IDLE,		///< only run when the CPU would be idle otherwise
+	GEN_POOL_LOW,		///< run below the priority of the game
+	GEN_POOL_NORMAL		///< run with the same priority as the game
+} gen_pool_priority_t;
+
+/// \brief Generates the entire world of the given seed into its cache file.
+/// This is what the world pool instances of the game run; does nothing but
+/// map the cache if it's valid already.
+/// \param seed			random number seed of the world
+void gen_pool_pregenerate(int seed);
+
+/// \brief Starts pre-generating the worlds of the upcoming seeds.
+/// The worlds are generated one after another, each by a headless instance of
+/// the game started with the \c -pregen command line option and the current
+/// world size, terrain budget and random number generator settings, so that
+/// loading them later on only takes mapping their cache files.
+/// \param exe			path to the game executable
+/// \param seed			first seed to generate
+/// \param count		number of consecutive seeds to generate
+/// \param threads		number of worker threads of every instance
+/// \param priority		scheduling priority of the instances
+/// \return				true if the pool has been started
+bool gen_pool_start(const char *exe, int seed, int count, int threads,
+					gen_pool_priority_t priority);
+
+/// \brief Stops the world pool, terminating the world being generated.
+/// Does nothing if the pool hasn't been started.
+void gen_pool_stop(void);
+
+/// \brief Pauses the world pool, e.g. while the game loads a world itself.
+/// No more worlds are started, and the one being generated is suspended (or,
+/// on Windows, dropped to the idle priority) until \ref gen_pool_resume.
+/// Does nothing if the pool hasn't been started.
+void gen_pool_pause(void);
+
+/// \brief Resumes a paused world pool, moving it on to the given seed.
+/// The world being generated is finished, and then the pool carries on with
+/// the given seed and as many following ones as it was started with, skipping
+/// those it has already generated. Does nothing if the pool hasn't been
+/// started.
+/// \param seed			new first seed to generate
+void gen_pool_resume(int seed);
 
 /// \brief Generates the terrain heightmap.
-/// \note				The heightmap is stored in stack memory, therefore it
-///						should not be freed.
-/// \return				constant pointer to the heightmap
+/// The heightmap is stored in a cache file named after the seed. If a valid
+/// cache file exists, it is mapped into memory instead of generating the
+/// heightmap anew. Either way the heightmap may be modified in memory.
+/// \note				The heightmap must be released with
+///						\ref gen_free_terrain.
 /// \param seed			random number seed; ensures identical random number
 ///						sequence each run
 void gen_terrain(int seed);
 
+/// \brief Releases the terrain heightmap and closes the world's cache file.
+void gen_free_terrain(void);
+
+/// \brief Returns the height of the given heightmap texel.
+/// If the heightmap is streamed and the texel's chunk isn't resident, it is
+/// generated on the spot, which may take a while; the game should use
+/// \ref gen_height_approx instead.
+/// \param x			heightmap X coordinate
+/// \param y			heightmap Y coordinate
+/// \return				texel value
+uchar gen_height(int x, int y);
+
+/// \brief Returns the height of the given heightmap texel without blocking.
+/// If the heightmap is streamed and the texel's chunk isn't resident, the
+/// value is taken from the low resolution overview map instead, and the chunk
+/// is queued for generation in the background.
+/// \param x			heightmap X coordinate
+/// \param y			heightmap Y coordinate
+/// \return				texel value
+uchar gen_height_approx(int x, int y);
+
+/// \brief Requests the streamed heightmap chunks around a point.
+/// Picks up the chunks finished in the background and queues the missing ones
+/// for generation, nearest first. Does nothing if the heightmap isn't
+/// streamed.
+/// \param x			world X coordinate of the point
+/// \param z			world Z coordinate of the point
+/// \param radius		radius of the area to keep resident, in metres
+void gen_stream_update(float x, float z, float radius);
+
+/// \brief Returns the heightmap to upload as the terrain texture.
+/// This is either the entire heightmap or, if it's streamed, its low
+/// resolution overview map.
+/// \param size			pointer to where to store the map dimension
+/// \return				map byte array
+const uchar *gen_terrain_texture(int *size);
+
+/// \brief Digs a crater into the terrain.
+/// Lowers the heightmap in a bowl around the given point, updates the height
+/// range pyramid over it and drops the props standing in it onto the new
+/// surface, along with the bounds of their prop tree nodes, so that it only
+/// costs as much as the crater is large. The changed region is queued for the
+/// renderer (see \ref gen_next_dirty_rect).
+/// \note				Streamed heightmaps can't be deformed, as their chunks
+///						are generated anew whenever they're paged in.
+/// \param x			heightmap X coordinate of the centre
+/// \param y			heightmap Y coordinate of the centre
+/// \param radius		radius of the crater in metres
+/// \param depth		depth of the crater in its centre in metres
+/// \return				true if the heightmap has changed
+bool gen_crater(float x, float y, float radius, float depth);
+
+/// \brief Fetches a region of the heightmap changed by \ref gen_crater.
+/// Regions are returned once each, in no particular order; overlapping ones are
+/// merged together.
+/// \param rect			array to store the heightmap coordinates of the first
+///						and last (inclusive) texel of the region in: X0, Y0,
+///						X1, Y1
+/// \return				false if no regions have changed since the last call
+bool gen_next_dirty_rect(int rect[4]);
+
+/// \brief Returns the range of heights of the terrain over a rectangle.
+/// The range is taken from a min/max pyramid built along with the heightmap,
+/// so it is conservative: it bounds the entire surface interpolated over the
+/// rectangle, but may be somewhat wider than the actual range. The coordinates
+/// are clamped to the heightmap. Never blocks, even if the heightmap is
+/// streamed.
+/// \param x0			heightmap X coordinate of the first texel
+/// \param y0			heightmap Y coordinate of the first texel
+/// \param x1			heightmap X coordinate of the last texel (inclusive)
+/// \param y1			heightmap Y coordinate of the last texel (inclusive)
+/// \param range		array to store the minimum and maximum texel value in
+void gen_height_range(int x0, int y0, int x1, int y1, uchar range[2]);
+
+/// \brief Returns the number of levels of the height range pyramid.
+/// Level 0 has a cell for every 2^\ref HEIGHT_RANGE_SHIFT texels in either
+/// direction, every next one half as many, down to a single cell.
+/// \return				number of levels, 0 if there is no terrain
+int gen_height_range_levels(void);
+
+/// \brief Returns a single cell of the height range pyramid.
+/// A cell bounds the texels of its square, as well as the first row and column
+/// of texels beyond it, so that it covers the surface interpolated up to them.
+/// \param level		pyramid level (see \ref gen_height_range_levels)
+/// \param x			cell X coordinate at the given level
+/// \param y			cell Y coordinate at the given level
+/// \return				pointer to the minimum and maximum texel value
+const uchar *gen_height_range_cell(int level, int x, int y);
+
 /// \brief Generates props (trees, buildings) resources.
 /// \param texture		texture byte array
 /// \param verts		vertex array
@@ -210,10 +498,30 @@ void gen_fx(uchar *texture, ac_vertex_t *verts, uchar *indices);
 void gen_proplists(int *numTrees, ac_tree_t *trees,
 					int *numBldgs, ac_bldg_t *bldgs);
 
-/// \brief Frees the given prop tree node and all of its children.
-/// \param n			pointer to the node of the tree to free (pass NULL to
-///						free the entire tree)
-void gen_free_proptree(ac_prop_t *n);
+/// \brief Computes the AABB of a prop tree node.
+/// \param n			pointer to the node
+/// \param x			prop map X coordinate of the node's corner
+/// \param y			prop map Y coordinate of the node's corner
+/// \param size			dimension of the node in prop map squares (that of
+///						the root is \ref PROPMAP_SIZE, that of its children
+///						is half of it and so on)
+/// \param bounds		array to write the 2 corners of the AABB to
+void gen_prop_bounds(const ac_prop_t *n, int x, int y, int size,
+					ac_vec4_t bounds[2]);
+
+/// \brief Computes the AABBs of all the children of a prop tree branch.
+/// The boxes are packed for testing all at once, the child in quadrant i in
+/// lane i; the lanes of missing children hold empty boxes.
+/// \param n			pointer to the branch node
+/// \param x			prop map X coordinate of the node's corner
+/// \param y			prop map Y coordinate of the node's corner
+/// \param size			dimension of the node in prop map squares
+/// \param bounds		pointer to where to write the boxes
+void gen_prop_child_bounds(const ac_prop_t *n, int x, int y, int size,
+					ac_box4_t *bounds);
+
+/// \brief Frees the prop tree.
+void gen_free_proptree(void);
 
 /// @}
 
@@ -232,6 +540,18 @@ void gen_free_proptree(ac_prop_t *n);
 bool r_init(uint *vcounter, uint *tcounter,
 					uint *dpcounter, uint *cpcounter);
 
+/// \brief Generates the procedural renderer resources (prop and special
+/// effects geometry and textures).
+/// Doesn't touch OpenGL, so it may be called on any thread, e.g. while the
+/// main one keeps drawing the loading screen.
+void r_generate_resources(void);
+
+/// \brief Uploads the resources made by \ref r_generate_resources to OpenGL.
+/// Replaces those of the previous world, if any.
+/// \note				Must be called on the main thread, after
+///						\ref r_generate_resources has returned
+void r_upload_resources(void);
+
 /// \brief Shuts the renderer down.
 void r_shutdown(void);
 
@@ -359,9 +679,19 @@ typedef struct {
 } ac_input_t;
 
 /// \brief Initializes the game logic.
+/// Generates the game world on a background thread, drawing the loading
+/// screen and uploading the renderer resources as they become ready in the
+/// meantime. Returns once the world is complete.
 /// \return true on success
 bool g_init(void);
 
+/// \brief Replaces the game world with the one of another seed.
+/// Loads the new world just like \ref g_init does; if its cache file is
+/// already complete (e.g. made by the world pool), this only maps the cached
+/// data and replaces the textures.
+/// \param seed			random seed of the new world
+void g_switch_world(int seed);
+
 /// \brief Shuts the game logic down.
 void g_shutdown(void);
 
@@ -371,8 +701,9 @@ void g_shutdown(void);
 /// \param input		current state of player input
 void g_frame(int ticks, float frameTime, ac_input_t *input);
 
-/// \brief Updates the game loading screen.
-/// \note				Only to be called before \ref g_init
+/// \brief Advances the loading progress by one tick.
+/// Only bumps an atomic counter; the loading screen is drawn by \ref g_init on
+/// the main thread, so this may be called from any thread.
 void g_loading_tick(void);
 
 /// @}
@@ -0,0 +1,204 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Worker thread pool; hands out bands of independent work items to a fixed set
+// of SDL threads
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <SDL2/SDL.h>
+#include "ac_jobs.h"
+
+/// Job descriptor; lives on the stack of the submitting thread.
+typedef struct ac_job_s {
+	ac_job_func_t		func;	///< item callback
+	void				*ctx;	///< callback context
+	int					count;	///< total number of items
+	int					grain;	///< number of items handed out at once
+	int					next;	///< first item not yet handed out
+	int					done;	///< number of finished items
+	struct ac_job_s		*link;	///< next job in the queue
+} ac_job_t;
+
+static SDL_mutex	*ac_jobs_lock = NULL;
+static SDL_cond		*ac_jobs_wake = NULL;		///< signalled on new jobs
+static SDL_cond		*ac_jobs_progress = NULL;	///< signalled on finished items
+static SDL_Thread	**ac_jobs_threads = NULL;
+static int			ac_jobs_nthreads = 0;
+static bool			ac_jobs_quit = false;
+static ac_job_t		*ac_jobs_queue = NULL;
+
+/// Hands out the next band of a job's items. Must be called with the lock held.
+static inline void ac_jobs_claim(ac_job_t *j, int *first, int *last) {
+	*first = j->next;
+	*last = *first + j->grain;
+	if (*last > j->count)
+		*last = j->count;
+	j->next = *last;
+}
+
+/// Processes the given band of items, accounting each of them as finished.
+static void ac_jobs_process(ac_job_t *j, int first, int last) {
+	int i;
+	for (i = first; i < last; i++) {
+		j->func(j->ctx, i);
+		SDL_LockMutex(ac_jobs_lock);
+		j->done++;
+		SDL_CondBroadcast(ac_jobs_progress);
+		SDL_UnlockMutex(ac_jobs_lock);
+	}
+}
+
+static int ac_jobs_worker(void *unused) {
+	ac_job_t *j;
+	int first, last;
+
+	(void)unused;	// shut up compiler
+
+	SDL_LockMutex(ac_jobs_lock);
+	while (!ac_jobs_quit) {
+		// find the oldest job that still has items to hand out
+		for (j = ac_jobs_queue; j && j->next >= j->count; j = j->link);
+		if (!j) {
+			SDL_CondWait(ac_jobs_wake, ac_jobs_lock);
+			continue;
+		}
+		ac_jobs_claim(j, &first, &last);
+		SDL_UnlockMutex(ac_jobs_lock);
+		// the job stays queued until all of its items are done, so it's safe
+		// to touch it without the lock
+		ac_jobs_process(j, first, last);
+		SDL_LockMutex(ac_jobs_lock);
+	}
+	SDL_UnlockMutex(ac_jobs_lock);
+	return 0;
+}
+
+bool ac_jobs_init(int numThreads) {
+	char name[32];
+	int i;
+
+	assert(ac_jobs_threads == NULL);
+
+	if (numThreads < 0)
+		numThreads = SDL_GetCPUCount() - 1;
+	if (numThreads < 1)
+		// there's no point in spawning anything, run everything serially
+		return true;
+
+	ac_jobs_lock = SDL_CreateMutex();
+	ac_jobs_wake = SDL_CreateCond();
+	ac_jobs_progress = SDL_CreateCond();
+	ac_jobs_threads = calloc(numThreads, sizeof(*ac_jobs_threads));
+	if (!ac_jobs_lock || !ac_jobs_wake || !ac_jobs_progress
+		|| !ac_jobs_threads) {
+		ac_jobs_shutdown();
+		return false;
+	}
+
+	ac_jobs_quit = false;
+	for (i = 0; i < numThreads; i++) {
+		snprintf(name, sizeof(name), "ac_worker%d", i);
+		ac_jobs_threads[i] = SDL_CreateThread(ac_jobs_worker, name, NULL);
+		if (!ac_jobs_threads[i])
+			break;
+	}
+	ac_jobs_nthreads = i;
+	if (ac_jobs_nthreads < 1) {
+		ac_jobs_shutdown();
+		return false;
+	}
+	return true;
+}
+
+void ac_jobs_shutdown(void) {
+	int i;
+
+	if (ac_jobs_lock) {
+		SDL_LockMutex(ac_jobs_lock);
+		ac_jobs_quit = true;
+		SDL_CondBroadcast(ac_jobs_wake);
+		SDL_UnlockMutex(ac_jobs_lock);
+	}
+	for (i = 0; i < ac_jobs_nthreads; i++)
+		SDL_WaitThread(ac_jobs_threads[i], NULL);
+	free(ac_jobs_threads);
+	ac_jobs_threads = NULL;
+	ac_jobs_nthreads = 0;
+
+	if (ac_jobs_progress)
+		SDL_DestroyCond(ac_jobs_progress);
+	if (ac_jobs_wake)
+		SDL_DestroyCond(ac_jobs_wake);
+	if (ac_jobs_lock)
+		SDL_DestroyMutex(ac_jobs_lock);
+	ac_jobs_progress = NULL;
+	ac_jobs_wake = NULL;
+	ac_jobs_lock = NULL;
+}
+
+int ac_jobs_num_threads(void) {
+	return ac_jobs_nthreads;
+}
+
+void ac_jobs_run(int count, int grain, ac_job_func_t func, void *ctx,
+					void (*tick)(void)) {
+	ac_job_t job, **tail;
+	int i, first, last, ticked = 0, pending;
+
+	if (grain < 1)
+		grain = 1;
+
+	if (ac_jobs_nthreads < 1) {
+		// no pool, do the work ourselves
+		for (i = 0; i < count; i++) {
+			func(ctx, i);
+			if (tick)
+				tick();
+		}
+		return;
+	}
+
+	job.func = func;
+	job.ctx = ctx;
+	job.count = count;
+	job.grain = grain;
+	job.next = 0;
+	job.done = 0;
+	job.link = NULL;
+
+	SDL_LockMutex(ac_jobs_lock);
+	for (tail = &ac_jobs_queue; *tail; tail = &(*tail)->link);
+	*tail = &job;
+	SDL_CondBroadcast(ac_jobs_wake);
+
+	for (;;) {
+		// report progress from this thread only
+		pending = job.done - ticked;
+		if (pending > 0 && tick) {
+			ticked = job.done;
+			SDL_UnlockMutex(ac_jobs_lock);
+			while (pending--)
+				tick();
+			SDL_LockMutex(ac_jobs_lock);
+			continue;
+		}
+		ticked = job.done;
+		if (job.done >= count)
+			break;
+		if (job.next < count) {
+			// help out instead of just waiting
+			ac_jobs_claim(&job, &first, &last);
+			SDL_UnlockMutex(ac_jobs_lock);
+			ac_jobs_process(&job, first, last);
+			SDL_LockMutex(ac_jobs_lock);
+		} else
+			SDL_CondWait(ac_jobs_progress, ac_jobs_lock);
+	}
+
+	// unlink the job
+	for (tail = &ac_jobs_queue; *tail != &job; tail = &(*tail)->link);
+	*tail = job.link;
+	SDL_UnlockMutex(ac_jobs_lock);
+}
@@ -0,0 +1,52 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+#ifndef AC_JOBS_H
+#define AC_JOBS_H
+
+#include <stdbool.h>
+
+/// \file ac_jobs.h
+/// \brief Public interface to the worker thread pool.
+/// \addtogroup jobs Worker thread pool
+/// @{
+
+/// \brief Job item callback.
+/// Processes a single item of a job (e.g. a single heightmap row). Items of the
+/// same job may be processed concurrently and in any order, so the callback
+/// must not depend on the results of other items.
+/// \param ctx			opaque pointer passed to \ref ac_jobs_run
+/// \param item			index of the item to process
+typedef void (*ac_job_func_t)(void *ctx, int item);
+
+/// \brief Spawns the worker threads.
+/// \note				If the pool is not initialized, all jobs are executed
+///						serially on the calling thread
+/// \param numThreads	number of worker threads to spawn; pass a negative
+///						value to spawn one thread less than there are CPU cores
+///						(the thread that submits a job takes part in it, too)
+/// \return				true on success
+bool ac_jobs_init(int numThreads);
+
+/// \brief Stops and joins all the worker threads.
+void ac_jobs_shutdown(void);
+
+/// \brief Returns the number of worker threads in the pool.
+int ac_jobs_num_threads(void);
+
+/// \brief Runs a job on the pool and waits for its completion.
+/// The items are handed out to the workers in bands of \e grain consecutive
+/// items. The calling thread processes bands as well.
+/// \param count		number of items in the job
+/// \param grain		number of consecutive items to hand out at once
+/// \param func			item callback
+/// \param ctx			opaque pointer to pass to the callback
+/// \param tick			optional function to call once per finished item; it
+///						is only ever called from the calling thread, which makes
+///						it safe for e.g. redrawing the loading screen
+void ac_jobs_run(int count, int grain, ac_job_func_t func, void *ctx,
+					void (*tick)(void));
+
+/// @}
+
+#endif // AC_JOBS_H
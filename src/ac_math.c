@@ -5,6 +5,7 @@
 // compiled into the program
 
 #include <assert.h>
+#include <string.h>
 #include "ac_math.h"
 
 static const unsigned int	negzero = 0x80000000;
@@ -20,7 +21,7 @@ inline float ac_max(float a, float b) {
 inline ac_vec4_t ac_vec_set(float x, float y, float z, float w) {
 	return (ac_vec4_t)_mm_set_ps(w, z, y, x);
 }
-
+
 inline ac_vec4_t ac_vec_setall(float b) {
 	return (ac_vec4_t)_mm_set1_ps(b);
 }
@@ -92,3 +93,168 @@ inline void ac_vec_tofloat(ac_vec4_t a, float b[4]) {
 inline ac_vec4_t ac_vec_tosse(float *f) {
 	return ac_vec_set(f[0], f[1], f[2], f[3]);
 }
+
+/// Picks the lanes of a where the mask is set, and of b elsewhere.
+static inline __m128 ac_select(__m128 mask, __m128 a, __m128 b) {
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline float ac_box_trace(ac_vec4_t p1, ac_vec4_t p2,
+	const ac_vec4_t bounds[2]) {
+	float d1, d2, f;
+	float enterFrac = -1.f, leaveFrac = 1.f;
+	int i, startOut = 0;
+
+	for (i = 0; i < 6; i++) {
+		if (i < 3) {
+			d1 = bounds[0].f[i] - p1.f[i];
+			d2 = bounds[0].f[i] - p2.f[i];
+		} else {
+			d1 = p1.f[i - 3] - bounds[1].f[i - 3];
+			d2 = p2.f[i - 3] - bounds[1].f[i - 3];
+		}
+		if (d1 > 0)
+			startOut = 1;
+		// if completely in front of face, no intersection with the entire box
+		if (d1 > 0 && (d2 >= 0.f || d2 >= d1))
+			return 1.f;
+		// if it doesn't cross the plane, the plane isn't relevant
+		if (d1 <= 0 && d2 <= 0)
+			continue;
+		// crosses face
+		f = d1 / (d1 - d2);
+		if (d1 > d2) {	// enter
+			if (f < 0)
+				f = 0;
+			if (f > enterFrac)
+				enterFrac = f;
+		} else {	// leave
+			if (f > 1)
+				f = 1;
+			if (f < leaveFrac)
+				leaveFrac = f;
+		}
+	}
+	if (!startOut)
+		return 0.f;
+	if (enterFrac < leaveFrac)
+		return enterFrac > 0 ? enterFrac : 0.f;
+	return 1.f;
+}
+
+inline ac_vec4_t ac_box4_trace4(const ac_vec4_t p1[3], const ac_vec4_t p2[3],
+	const ac_box4_t *b) {
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+	__m128 d1, d2, f, enter, leave, enterFrac, leaveFrac, startOut, miss;
+	__m128 p1s, p2s;
+	int i;
+
+	enterFrac = _mm_set1_ps(-1.f);
+	leaveFrac = one;
+	startOut = zero;
+	miss = zero;
+	for (i = 0; i < 6; i++) {
+		// the distances of the segment's ends in front of the face
+		p1s = p1[i % 3].sse;
+		p2s = p2[i % 3].sse;
+		if (i < 3) {
+			d1 = _mm_sub_ps(b->mins[i].sse, p1s);
+			d2 = _mm_sub_ps(b->mins[i].sse, p2s);
+		} else {
+			d1 = _mm_sub_ps(p1s, b->maxs[i - 3].sse);
+			d2 = _mm_sub_ps(p2s, b->maxs[i - 3].sse);
+		}
+		f = _mm_cmpgt_ps(d1, zero);
+		startOut = _mm_or_ps(startOut, f);
+		// completely in front of the face, no intersection with the box
+		miss = _mm_or_ps(miss, _mm_and_ps(f, _mm_or_ps(_mm_cmpge_ps(d2, zero),
+			_mm_cmpge_ps(d2, d1))));
+		// the faces the segment crosses, entering or leaving the box; the
+		// fractions of the other lanes are bogus, but never picked
+		enter = _mm_cmpgt_ps(d1, d2);
+		leave = _mm_andnot_ps(enter, _mm_cmpgt_ps(d2, zero));
+		enter = _mm_and_ps(enter, _mm_or_ps(f, _mm_cmpgt_ps(d2, zero)));
+		f = _mm_div_ps(d1, _mm_sub_ps(d1, d2));
+		enterFrac = ac_select(enter,
+			_mm_max_ps(enterFrac, _mm_max_ps(f, zero)), enterFrac);
+		leaveFrac = ac_select(leave,
+			_mm_min_ps(leaveFrac, _mm_min_ps(f, one)), leaveFrac);
+	}
+	// the box is hit where the segment enters it before leaving any face
+	f = ac_select(_mm_cmplt_ps(enterFrac, leaveFrac),
+		_mm_max_ps(enterFrac, zero), one);
+	f = ac_select(startOut, f, zero);
+	return (ac_vec4_t)ac_select(miss, one, f);
+}
+
+/// Number of groups of 4 segments traced by \ref ac_box4_check.
+#define CHECK_GROUPS	4096
+
+/// Next number of the private sequence of \ref ac_box4_check, in [-16, 16).
+static float ac_check_coord(unsigned int *state) {
+	*state = *state * 1664525 + 1013904223;
+	// multiples of 1/16, so that the coordinates often coincide exactly
+	return (float)(int)(*state >> 23) * (1.f / 16.f) - 16.f;
+}
+
+int ac_box4_check(void) {
+	static int result = -1;
+	ac_vec4_t p1[4], p2[4], bounds[4][2], p1s[3], p2s[3], frac;
+	ac_box4_t b;
+	unsigned int state = 1;
+	float ref;
+	int i, j, k;
+
+	if (result >= 0)
+		return result;
+
+	result = 1;
+	for (i = 0; i < CHECK_GROUPS; i++) {
+		for (j = 0; j < 4; j++) {
+			for (k = 0; k < 3; k++) {
+				bounds[j][0].f[k] = ac_check_coord(&state) * 0.5f;
+				bounds[j][1].f[k] = bounds[j][0].f[k]
+					+ (ac_check_coord(&state) + 16.f) * 0.25f;
+				p1[j].f[k] = ac_check_coord(&state);
+				p2[j].f[k] = ac_check_coord(&state);
+			}
+			k = (i + j) % 3;
+			switch ((i * 4 + j) % 8) {
+				case 1:	// parallel to a pair of faces
+					p2[j].f[k] = p1[j].f[k];
+					break;
+				case 2:	// starting inside the box
+					p1[j] = ac_vec_mulf(ac_vec_add(bounds[j][0], bounds[j][1]),
+						0.5f);
+					break;
+				case 3:	// zero length
+					p2[j] = p1[j];
+					break;
+				case 4:	// starting on a face
+					p1[j].f[k] = bounds[j][i & 1].f[k];
+					break;
+				case 5:	// ending on a face
+					p2[j].f[k] = bounds[j][i & 1].f[k];
+					break;
+				case 6:	// lying in the plane of a face
+					p1[j].f[k] = p2[j].f[k] = bounds[j][i & 1].f[k];
+					break;
+				default:
+					break;
+			}
+			for (k = 0; k < 3; k++) {
+				p1s[k].f[j] = p1[j].f[k];
+				p2s[k].f[j] = p2[j].f[k];
+				b.mins[k].f[j] = bounds[j][0].f[k];
+				b.maxs[k].f[j] = bounds[j][1].f[k];
+			}
+		}
+		frac = ac_box4_trace4(p1s, p2s, &b);
+		for (j = 0; j < 4; j++) {
+			ref = ac_box_trace(p1[j], p2[j], bounds[j]);
+			if (memcmp(&ref, &frac.f[j], sizeof(ref)))
+				result = 0;
+		}
+	}
+	return result;
+}
@@ -99,6 +99,44 @@ extern inline void ac_vec_tofloat(ac_vec4_t a, float b[4]) STACK_ALIGN;
 /// Write from flat floats (a) to __m128 (b).
 extern inline ac_vec4_t ac_vec_tosse(float *f) STACK_ALIGN;
 
+/// \brief 4 axis-aligned boxes in structure-of-arrays layout.
+/// Lane i of every vector belongs to box i, so the boxes can be tested all at
+/// once. Unused lanes should hold empty boxes (minimums of FLT_MAX, maximums
+/// of -FLT_MAX), which nothing ever hits.
+typedef struct {
+	ac_vec4_t	mins[3];	///< minimum X, Y and Z coordinates of the boxes
+	ac_vec4_t	maxs[3];	///< maximum X, Y and Z coordinates of the boxes
+} ac_box4_t;
+
+/// \brief Traces a line segment through an axis-aligned box.
+/// Every face of the box is clipped against in turn. This is the reference
+/// implementation of \ref ac_box4_trace4.
+/// \param p1		start of the segment
+/// \param p2		end of the segment
+/// \param bounds	minimum and maximum corners of the box
+/// \return			fraction of the segment at which it enters the box: 0 if it
+///					starts inside the box, 1 if it doesn't hit the box at all
+extern inline float ac_box_trace(ac_vec4_t p1, ac_vec4_t p2,
+	const ac_vec4_t bounds[2]) STACK_ALIGN;
+
+/// \brief Traces 4 line segments through 4 axis-aligned boxes, each through
+/// its own one.
+/// Gives bit-identical results to \ref ac_box_trace for every lane.
+/// \param p1	starts of the segments: the X, Y and Z coordinates of all 4
+/// \param p2	ends of the segments, likewise
+/// \param b	boxes to trace through
+/// \return		see \ref ac_box_trace, for every lane
+extern inline ac_vec4_t ac_box4_trace4(const ac_vec4_t p1[3],
+	const ac_vec4_t p2[3], const ac_box4_t *b) STACK_ALIGN;
+
+/// \brief Checks \ref ac_box4_trace4 against \ref ac_box_trace.
+/// Traces a fixed set of pseudo-random segments, including the corner cases
+/// of segments parallel to the faces, touching them, starting inside the boxes
+/// and of zero length. The check is only run once; subsequent calls return the
+/// cached result.
+/// \return		non-zero if all the results were bit-identical
+int ac_box4_check(void);
+
 /// @}
 
 #endif // AC_MATH_H
@@ -5,151 +5,474 @@
 
 #include "g_local.h"
 
-static inline float g_trace_through_AABB(ac_vec4_t p1, ac_vec4_t p2,
-	ac_vec4_t bounds[2]) {
-	float d1, d2, f;
-	float enterFrac = -1.f, leaveFrac = 1.f;
-	bool startOut = false;
-	int i;
-	if (!bounds)
-		return 1.f;
-	for (i = 0; i < 6; i++) {
-		if (i < 3) {
-			d1 = -p1.f[i] + bounds[0].f[i];
-			d2 = -p2.f[i] + bounds[0].f[i];
+/// Number of segments traced by a single job item of \ref g_collide_many.
+#define COLLIDE_BLOCK		16
+/// Number of blocks below which a batch isn't worth splitting across threads.
+#define COLLIDE_MIN_BLOCKS	4
+
+/// \brief Traces the segment through a list of buildings, 4 at a time.
+/// The segment is transformed into the object space of every building, where
+/// the building is just an AABB centred on the origin, using the terms of the
+/// inverse rotation from the collision table.
+/// \param bldgs		indices of the buildings
+/// \param count		number of buildings
+/// \param curFrac		fraction of the closest hit so far
+/// \return				fraction of the closest hit so far
+static float g_trace_through_bldgs(ac_vec4_t p1, ac_vec4_t p2,
+	const int *bldgs, int count, float curFrac) {
+	const ac_bldg_coll_t *t = &gen_bldg_coll;
+	__m128 c, s, d1[3], d2[3];
+	ac_vec4_t l1[3], l2[3], fracs;
+	ac_box4_t bounds;
+	int i, j, k[4];
+
+	for (i = 0; i < count; i += 4) {
+		// repeat the last building in the unused lanes
+		for (j = 0; j < 4; j++)
+			k[j] = bldgs[i + j < count ? i + j : count - 1];
+		// make the translation relative
+		d1[0] = _mm_sub_ps(_mm_set1_ps(p1.f[0]),
+			_mm_set_ps(t->x[k[3]], t->x[k[2]], t->x[k[1]], t->x[k[0]]));
+		d1[1] = _mm_sub_ps(_mm_set1_ps(p1.f[1]),
+			_mm_set_ps(t->y[k[3]], t->y[k[2]], t->y[k[1]], t->y[k[0]]));
+		d1[2] = _mm_sub_ps(_mm_set1_ps(p1.f[2]),
+			_mm_set_ps(t->z[k[3]], t->z[k[2]], t->z[k[1]], t->z[k[0]]));
+		d2[0] = _mm_sub_ps(_mm_set1_ps(p2.f[0]),
+			_mm_set_ps(t->x[k[3]], t->x[k[2]], t->x[k[1]], t->x[k[0]]));
+		d2[1] = _mm_sub_ps(_mm_set1_ps(p2.f[1]),
+			_mm_set_ps(t->y[k[3]], t->y[k[2]], t->y[k[1]], t->y[k[0]]));
+		d2[2] = _mm_sub_ps(_mm_set1_ps(p2.f[2]),
+			_mm_set_ps(t->z[k[3]], t->z[k[2]], t->z[k[1]], t->z[k[0]]));
+		// then undo the rotation; the rows of the inverse rotation matrix are
+		// [c, 0, -s] and [s, 0, c]
+		c = _mm_set_ps(t->c[k[3]], t->c[k[2]], t->c[k[1]], t->c[k[0]]);
+		s = _mm_set_ps(t->s[k[3]], t->s[k[2]], t->s[k[1]], t->s[k[0]]);
+		l1[0].sse = _mm_sub_ps(_mm_mul_ps(d1[0], c), _mm_mul_ps(d1[2], s));
+		l1[1].sse = d1[1];
+		l1[2].sse = _mm_add_ps(_mm_mul_ps(d1[0], s), _mm_mul_ps(d1[2], c));
+		l2[0].sse = _mm_sub_ps(_mm_mul_ps(d2[0], c), _mm_mul_ps(d2[2], s));
+		l2[1].sse = d2[1];
+		l2[2].sse = _mm_add_ps(_mm_mul_ps(d2[0], s), _mm_mul_ps(d2[2], c));
+		// the boxes are symmetrical about the origin
+		bounds.maxs[0].sse = _mm_set_ps(t->hx[k[3]], t->hx[k[2]],
+			t->hx[k[1]], t->hx[k[0]]);
+		bounds.maxs[1].sse = _mm_set_ps(t->hy[k[3]], t->hy[k[2]],
+			t->hy[k[1]], t->hy[k[0]]);
+		bounds.maxs[2].sse = _mm_set_ps(t->hz[k[3]], t->hz[k[2]],
+			t->hz[k[1]], t->hz[k[0]]);
+		for (j = 0; j < 3; j++)
+			bounds.mins[j] = ac_vec_negate(bounds.maxs[j]);
+		fracs = ac_box4_trace4(l1, l2, &bounds);
+		for (j = 0; j < 4; j++) {
+			if (fracs.f[j] < curFrac)
+				curFrac = fracs.f[j];
+		}
+	}
+	return curFrac;
+}
+
+/// \brief Intersects a ray with the bilinear patch of a single heightmap cell.
+/// The height of the ray above the patch is a quadratic function of the ray
+/// parameter, so its first root within the part of the ray over the cell is
+/// the exact point of entry into the terrain.
+/// \param p1		ray origin in heightmap coordinates
+/// \param v		ray direction
+/// \param x, z		heightmap coordinates of the cell's first texel
+/// \param tin		ray parameter at which the ray enters the cell
+/// \param tout		ray parameter at which the ray leaves the cell
+/// \param t		pointer to where to store the ray parameter of the hit
+/// \return			true if the ray hits the patch
+static inline bool g_trace_cell(ac_vec4_t p1, ac_vec4_t v, int x, int z,
+	float tin, float tout, float *t) {
+	float h00, h10, h01, h11, hmax, y0, y1, u0, w0;
+	float a, b, c, d, qa, qb, qc, disc, q, r1, r2;
+
+	// the chunks of a streamed heightmap that aren't there yet aren't worth
+	// stalling the frame for, the overview will do until they come in
+	h00 = gen_height_approx(x, z) * HEIGHT_SCALE;
+	h10 = gen_height_approx(x + 1, z) * HEIGHT_SCALE;
+	h01 = gen_height_approx(x, z + 1) * HEIGHT_SCALE;
+	h11 = gen_height_approx(x + 1, z + 1) * HEIGHT_SCALE;
+	// the patch never rises above its highest corner
+	y0 = p1.f[1] + v.f[1] * tin;
+	y1 = p1.f[1] + v.f[1] * tout;
+	hmax = h00 > h10 ? h00 : h10;
+	hmax = hmax > h01 ? hmax : h01;
+	hmax = hmax > h11 ? hmax : h11;
+	if (y0 > hmax && y1 > hmax)
+		return false;
+
+	// the surface is a + b * u + c * w + d * u * w over the cell; measure the
+	// ray parameter from the point of entry to keep the precision up
+	a = h00;
+	b = h10 - h00;
+	c = h01 - h00;
+	d = h00 - h10 - h01 + h11;
+	u0 = p1.f[0] + v.f[0] * tin - x;
+	w0 = p1.f[2] + v.f[2] * tin - z;
+	qc = y0 - (a + b * u0 + c * w0 + d * u0 * w0);
+	if (qc <= 0.f) {
+		// already at or below the surface
+		*t = tin;
+		return true;
+	}
+	qb = v.f[1] - b * v.f[0] - c * v.f[2] - d * (u0 * v.f[2] + w0 * v.f[0]);
+	qa = -d * v.f[0] * v.f[2];
+	tout -= tin;
+	if (fabsf(qa) < 1e-12f) {
+		// the ray runs along a ruling of the patch
+		if (qb >= 0.f || -qc / qb > tout)
+			return false;
+		*t = tin - qc / qb;
+		return true;
+	}
+	if ((disc = qb * qb - 4.f * qa * qc) < 0.f)
+		return false;
+	// numerically stable roots
+	q = -0.5f * (qb + (qb < 0.f ? -sqrtf(disc) : sqrtf(disc)));
+	r1 = q / qa;
+	r2 = q != 0.f ? qc / q : r1;
+	if (r1 > r2) {
+		q = r1;
+		r1 = r2;
+		r2 = q;
+	}
+	if (r1 < 0.f)
+		r1 = r2;
+	if (r1 < 0.f || r1 > tout)
+		return false;
+	*t = tin + r1;
+	return true;
+}
+
+/// \brief Clips the ray parameter range to a slab along a single axis.
+/// \param p		ray origin along the axis
+/// \param v		ray direction along the axis
+/// \param lo, hi	extents of the slab
+/// \param t0, t1	ray parameter range to clip
+/// \return			false if the range misses the slab altogether
+static inline bool g_clip_to_slab(float p, float v, float lo, float hi,
+	float *t0, float *t1) {
+	float ta, tb;
+
+	if (v == 0.f)
+		return p >= lo && p <= hi;
+	ta = (lo - p) / v;
+	tb = (hi - p) / v;
+	*t0 = (ta < tb ? ta : tb) > *t0 ? (ta < tb ? ta : tb) : *t0;
+	*t1 = (ta > tb ? ta : tb) < *t1 ? (ta > tb ? ta : tb) : *t1;
+	return *t0 <= *t1;
+}
+
+/// \brief Walks the heightmap cells of a square block crossed by the ray, in
+/// order, until one of them is hit (DDA).
+/// \param x0, z0	first cell of the block
+/// \param x1, z1	last cell of the block (inclusive)
+/// \param tin		ray parameter at which the ray enters the block
+/// \param tout		ray parameter at which the ray leaves the block
+/// \param t		pointer to where to store the ray parameter of the hit
+/// \return			true if the ray hits the terrain within the block
+static bool g_walk_cells(ac_vec4_t p1, ac_vec4_t v, int x0, int z0,
+	int x1, int z1, float tin, float tout, float *t) {
+	const int lo[2] = {x0, z0}, hi[2] = {x1, z1};
+	float tmax[2], tdelta[2], tnext;
+	int cell[2], step[2], axis;
+
+	for (axis = 0; axis < 2; axis++) {
+		cell[axis] = (int)floorf(p1.f[axis * 2] + v.f[axis * 2] * tin);
+		if (cell[axis] > hi[axis])
+			cell[axis] = hi[axis];
+		if (cell[axis] < lo[axis])
+			cell[axis] = lo[axis];
+		if (v.f[axis * 2] > 0.f) {
+			step[axis] = 1;
+			tdelta[axis] = 1.f / v.f[axis * 2];
+			tmax[axis] = (cell[axis] + 1 - p1.f[axis * 2]) / v.f[axis * 2];
+		} else if (v.f[axis * 2] < 0.f) {
+			step[axis] = -1;
+			tdelta[axis] = -1.f / v.f[axis * 2];
+			tmax[axis] = (cell[axis] - p1.f[axis * 2]) / v.f[axis * 2];
 		} else {
-			d1 = p1.f[i - 3] - bounds[1].f[i - 3];
-			d2 = p2.f[i - 3] - bounds[1].f[i - 3];
-		}
-		if (d1 > 0)
-            startOut = true;
-		// if completely in front of face, no intersection with the entire AABB
-		if (d1 > 0 && (d2 >= 0.f || d2 >= d1))
-			return 1.f;
-		// if it doesn't cross the plane, the plane isn't relevent
-		if (d1 <= 0 && d2 <= 0)
+			step[axis] = 0;
+			tdelta[axis] = 0.f;
+			tmax[axis] = FLT_MAX;
+		}
+	}
+	for (;; tin = tnext) {
+		axis = tmax[0] < tmax[1] ? 0 : 1;
+		tnext = tmax[axis] < tout ? tmax[axis] : tout;
+		if (g_trace_cell(p1, v, cell[0], cell[1], tin, tnext, t))
+			return true;
+		if (tnext >= tout)
+			return false;
+		cell[axis] += step[axis];
+		if (cell[axis] < lo[axis] || cell[axis] > hi[axis])
+			return false;
+		tmax[axis] += tdelta[axis];
+	}
+}
+
+/// \brief Traces the ray through a cell of the height range pyramid.
+/// Cells the ray passes entirely above are skipped, the rest are descended
+/// into front to back, down to the heightmap cells of the base level, so the
+/// cost grows with the length of the ray over the terrain only
+/// logarithmically, and linearly with the length of it near the surface.
+/// \param level		pyramid level
+/// \param cx, cz	cell coordinates at that level
+/// \param tin, tout	ray parameter range to trace
+/// \param t		pointer to where to store the ray parameter of the hit
+/// \return			true if the ray hits the terrain within the cell
+static bool g_trace_range(ac_vec4_t p1, ac_vec4_t v, int level, int cx,
+	int cz, float tin, float tout, float *t) {
+	const int shift = HEIGHT_RANGE_SHIFT + level;
+	const uchar *range = gen_height_range_cell(level, cx, cz);
+	float y0, y1, t0[4], t1[4], tmp;
+	int i, j, n, q[4], x, z;
+
+	// the cell bounds the surface up to its first texels past it
+	if (!g_clip_to_slab(p1.f[0], v.f[0], cx << shift, (cx + 1) << shift,
+			&tin, &tout)
+		|| !g_clip_to_slab(p1.f[2], v.f[2], cz << shift, (cz + 1) << shift,
+			&tin, &tout))
+		return false;
+	y0 = p1.f[1] + v.f[1] * tin;
+	y1 = p1.f[1] + v.f[1] * tout;
+	if (y0 > range[1] * HEIGHT_SCALE && y1 > range[1] * HEIGHT_SCALE)
+		return false;
+
+	if (level == 0) {
+		// the last row and column of texels don't start any cells
+		x = ((cx + 1) << shift) - 1;
+		z = ((cz + 1) << shift) - 1;
+		return g_walk_cells(p1, v, cx << shift, cz << shift,
+			x < HEIGHTMAP_SIZE - 2 ? x : HEIGHTMAP_SIZE - 2,
+			z < HEIGHTMAP_SIZE - 2 ? z : HEIGHTMAP_SIZE - 2, tin, tout, t);
+	}
+
+	// sort the children the ray crosses by the point of entry
+	for (i = 0, n = 0; i < 4; i++) {
+		t0[n] = tin;
+		t1[n] = tout;
+		if (!g_clip_to_slab(p1.f[0], v.f[0], (cx * 2 + (i & 1)) << (shift - 1),
+				(cx * 2 + (i & 1) + 1) << (shift - 1), &t0[n], &t1[n])
+			|| !g_clip_to_slab(p1.f[2], v.f[2],
+				(cz * 2 + (i >> 1)) << (shift - 1),
+				(cz * 2 + (i >> 1) + 1) << (shift - 1), &t0[n], &t1[n]))
 			continue;
-		// crosses face
-		if (d1 > d2) {	// enter
-			f = d1 / (d1 - d2);
-			if (f < 0)
-				f = 0;
-			if (f > enterFrac)
-				enterFrac = f;
-		} else {	// leave
-			f = d1 / (d1 - d2);
-			if (f > 1)
-				f = 1;
-			if (f < leaveFrac)
-				leaveFrac = f;
+		for (j = n; j > 0 && t0[j - 1] > t0[j]; j--) {
+			tmp = t0[j];
+			t0[j] = t0[j - 1];
+			t0[j - 1] = tmp;
+			tmp = t1[j];
+			t1[j] = t1[j - 1];
+			t1[j - 1] = tmp;
+			q[j] = q[j - 1];
 		}
-	}
-	if (!startOut)
-        return 0.f;
-	if (enterFrac < leaveFrac)
-		return (enterFrac > 0 ? enterFrac : 0.f);
+		q[j] = i;
+		n++;
+	}
+	for (i = 0; i < n; i++) {
+		if (g_trace_range(p1, v, level - 1, cx * 2 + (q[i] & 1),
+			cz * 2 + (q[i] >> 1), t0[i], t1[i], t))
+			return true;
+	}
+	return false;
+}
+
+/// \brief Traces the segment through the terrain.
+/// \param p1		start of the segment in heightmap coordinates
+/// \param p2		end of the segment in heightmap coordinates
+/// \param maxFrac	fraction of the segment past which hits don't matter
+/// \return			fraction of the segment at the hit, 1 if none
+static float g_collide_terrain(ac_vec4_t p1, ac_vec4_t p2, float maxFrac) {
+	ac_vec4_t v = ac_vec_sub(p2, p1);
+	const int levels = gen_height_range_levels();
+	float t0 = 0.f, t1 = maxFrac, t;
+
+	// only trace the part of the segment over the heightmap
+	if (!g_clip_to_slab(p1.f[0], v.f[0], 0, HEIGHTMAP_SIZE - 1, &t0, &t1)
+		|| !g_clip_to_slab(p1.f[2], v.f[2], 0, HEIGHTMAP_SIZE - 1, &t0, &t1))
+		return 1.f;
+	if (levels > 0 ? g_trace_range(p1, v, levels - 1, 0, 0, t0, t1, &t)
+		: g_walk_cells(p1, v, 0, 0, HEIGHTMAP_SIZE - 2, HEIGHTMAP_SIZE - 2,
+			t0, t1, &t))
+		return t;
+	// the trace hasn't hit the terrain
 	return 1.f;
 }
 
-static inline float g_trace_through_bldg(ac_vec4_t p1, ac_vec4_t p2,
-	ac_bldg_t *b) {
-	// OK, let's do this the easy way - transform the ray into the building's
-	// own object space and just treat it like a bounding box
-	float c, s;
-	ac_vec4_t x, z, l1, l2, bounds[2];
-	c = cosf(b->ang);
-	s = sinf(b->ang);
-	// these vectors make up the first and third rows of the inverse rotation
-	// matrix
-	x = ac_vec_set(c,
-					0.f,
-					-s,
-					0.f);
-	z = ac_vec_set(s,
-					0.f,
-					c,
-					0.f);
-	// now, do the actual transformation; first, make the translation relative
-	p1 = ac_vec_sub(p1, b->pos);
-	p2 = ac_vec_sub(p2, b->pos);
-	// then undo rotation
-	l1 = ac_vec_set(ac_vec_dot(p1, x),
-					p1.f[1],
-					ac_vec_dot(p1, z),
-					0.f);
-	l2 = ac_vec_set(ac_vec_dot(p2, x),
-					p2.f[1],
-					ac_vec_dot(p2, z),
-					0.f);
-	// calculate the bounding box
-	// cheat on the Y axis for slanted roof buildings
-	bounds[0] = ac_vec_set(-0.5 * b->Xscale,
-							b->slantedRoof ? -1.2 : -1.f,
-							-0.5 * b->Zscale,
-							0.f);
-	bounds[1] = ac_vec_mulf(bounds[0], -1.f);
-	// whew, that's about it!
-	return g_trace_through_AABB(l1, l2, bounds);
+/// \brief Traces the segment through the buildings.
+/// Walks the cells of the building collision grid the segment crosses, in
+/// order, and stops at the first one the closest hit so far lies within.
+/// \param p1		start of the segment in world coordinates
+/// \param p2		end of the segment in world coordinates
+/// \return			fraction of the segment at the closest hit, 1 if none
+static float g_collide_bldgs(ac_vec4_t p1, ac_vec4_t p2) {
+	const ac_bldg_coll_t *g = &gen_bldg_coll;
+	const float half = HEIGHTMAP_SIZE / 2;
+	const float size = 1 << g->cellShift;
+	ac_vec4_t v = ac_vec_sub(p2, p1);
+	float t0 = 0.f, t1 = 1.f, tin, tout, y0, y1, frac = 1.f, o;
+	float tmax[2], tdelta[2];
+	int cell[2], step[2], axis, k;
+
+	if (!g->cellStart || !g_clip_to_slab(p1.f[0], v.f[0], -half, half,
+			&t0, &t1)
+		|| !g_clip_to_slab(p1.f[2], v.f[2], -half, half, &t0, &t1))
+		return 1.f;
+
+	for (axis = 0; axis < 2; axis++) {
+		o = p1.f[axis * 2] + half;
+		cell[axis] = (int)floorf((o + v.f[axis * 2] * t0) / size);
+		if (cell[axis] > g->cellSide - 1)
+			cell[axis] = g->cellSide - 1;
+		if (cell[axis] < 0)
+			cell[axis] = 0;
+		if (v.f[axis * 2] > 0.f) {
+			step[axis] = 1;
+			tdelta[axis] = size / v.f[axis * 2];
+			tmax[axis] = ((cell[axis] + 1) * size - o) / v.f[axis * 2];
+		} else if (v.f[axis * 2] < 0.f) {
+			step[axis] = -1;
+			tdelta[axis] = -size / v.f[axis * 2];
+			tmax[axis] = (cell[axis] * size - o) / v.f[axis * 2];
+		} else {
+			step[axis] = 0;
+			tdelta[axis] = 0.f;
+			tmax[axis] = FLT_MAX;
+		}
+	}
+	for (tin = t0; ; tin = tout) {
+		axis = tmax[0] < tmax[1] ? 0 : 1;
+		tout = tmax[axis] < t1 ? tmax[axis] : t1;
+		// skip the cells the segment passes above all the buildings of
+		k = cell[1] * g->cellSide + cell[0];
+		y0 = p1.f[1] + v.f[1] * tin;
+		y1 = p1.f[1] + v.f[1] * tout;
+		if (g->cellStart[k + 1] > g->cellStart[k]
+			&& (y0 <= g->cellTop[k] || y1 <= g->cellTop[k]))
+			frac = g_trace_through_bldgs(p1, p2,
+				g->cellBldgs + g->cellStart[k],
+				g->cellStart[k + 1] - g->cellStart[k], frac);
+		// every building is listed in all the cells it overlaps, so no hit
+		// further down the segment can be any closer
+		if (frac <= tout || tout >= t1)
+			break;
+		cell[axis] += step[axis];
+		if (cell[axis] < 0 || cell[axis] > g->cellSide - 1)
+			break;
+		tmax[axis] += tdelta[axis];
+	}
+	return frac;
 }
 
-static float g_collide_bldgs(ac_vec4_t p1, ac_vec4_t p2, ac_prop_t *node,
-	float curFrac) {
-	int i;
+/// \brief Traces the segment through the buildings and the terrain.
+/// \param p1		start of the segment in heightmap coordinates
+/// \param p2		end of the segment in heightmap coordinates
+/// \return			fraction of the segment at the closest hit, 1 if none
+static float g_trace(ac_vec4_t p1, ac_vec4_t p2) {
+	// the traces are in heightmap coordinates, the buildings in world ones
+	const ac_vec4_t ofs = ac_vec_set(HEIGHTMAP_SIZE / 2, 0,
+		HEIGHTMAP_SIZE / 2, 0);
+	float frac = g_collide_bldgs(ac_vec_sub(p1, ofs), ac_vec_sub(p2, ofs));
+	float t;
+
+	// the terrain only needs tracing up to the closest building
+	t = g_collide_terrain(p1, p2, frac);
+	return t < frac ? t : frac;
+}
+
+/// \brief Returns the height no terrain or building reaches above.
+static float g_collision_ceiling(void) {
+	const int levels = gen_height_range_levels();
+	float top = gen_bldg_coll.top;
+
+	if (levels < 1)
+		return FLT_MAX;
+	if (top < gen_height_range_cell(levels - 1, 0, 0)[1] * HEIGHT_SCALE)
+		top = gen_height_range_cell(levels - 1, 0, 0)[1] * HEIGHT_SCALE;
+	return top;
+}
+
+/// Batch of segments to trace.
+typedef struct {
+	const ac_vec4_t		*p1, *p2;
+	ac_vec4_t			*hits;
+	float				*fracs;
+	int					count;
+	float				ceiling;	///< see \ref g_collision_ceiling
+} g_collide_batch_t;
+
+/// \brief Traces a block of \ref COLLIDE_BLOCK segments of a batch.
+/// The segments are first checked against the collision ceiling 4 at a time,
+/// and only the groups that reach below it are traced one by one.
+static void g_collide_block(void *ctx, int block) {
+	const g_collide_batch_t *b = ctx;
+	const __m128 ceiling = _mm_set1_ps(b->ceiling);
+	const int first = block * COLLIDE_BLOCK;
+	const int last = first + COLLIDE_BLOCK < b->count
+		? first + COLLIDE_BLOCK : b->count;
+	const ac_vec4_t *p1 = b->p1, *p2 = b->p2;
+	__m128 low;
 	float frac;
-	frac = g_trace_through_AABB(p1, p2, node->bounds);
-	if (node && node->bldgs) {
-		for (i = 0; i < BLDGS_PER_FIELD; i++) {
-			if ((frac = g_trace_through_bldg(p1, p2, node->bldgs + i))
-				< curFrac) {
-                printf("LOL %f\n", frac);
-				curFrac = frac;
-            }
+	int i, j, n;
+
+	for (i = first; i < last; i += 4) {
+		n = last - i < 4 ? last - i : 4;
+		if (n == 4) {
+			// the lowest point of a segment is one of its ends
+			low = _mm_min_ps(
+				_mm_set_ps(p1[i + 3].f[1], p1[i + 2].f[1],
+					p1[i + 1].f[1], p1[i].f[1]),
+				_mm_set_ps(p2[i + 3].f[1], p2[i + 2].f[1],
+					p2[i + 1].f[1], p2[i].f[1]));
+			if (!_mm_movemask_ps(_mm_cmple_ps(low, ceiling))) {
+				for (j = i; j < i + 4; j++) {
+					b->hits[j] = p2[j];
+					if (b->fracs)
+						b->fracs[j] = 1.f;
+				}
+				continue;
+			}
+		}
+		for (j = i; j < i + n; j++) {
+			if (p1[j].f[1] > b->ceiling && p2[j].f[1] > b->ceiling)
+				frac = 1.f;
+			else
+				frac = g_trace(p1[j], p2[j]);
+			b->hits[j] = frac < 1.f ? ac_vec_add(p1[j],
+				ac_vec_mul(ac_vec_sub(p2[j], p1[j]), ac_vec_setall(frac)))
+				: p2[j];
+			if (b->fracs)
+				b->fracs[j] = frac;
 		}
-	} else if (frac >= curFrac)
-		// if we haven't hit our AABB or we hit it further than the closest hit
-		// so far, we can't have anything of interest left
-		return 1.f;
-	if (!node)
-		return curFrac;
-	for (i = 0; i < 4; i++) {
-		if (!node->child[i])
-			continue;
-		if ((frac = g_collide_bldgs(p1, p2, node->child[i], curFrac))
-			< curFrac)
-			curFrac = frac;
 	}
-	return curFrac;
 }
 
-static ac_vec4_t g_collide_terrain(ac_vec4_t p1, ac_vec4_t p2) {
-	ac_vec4_t half = ac_vec_setall(0.5);
-	ac_vec4_t v = ac_vec_sub(p2, p1);
-	ac_vec4_t p;
-	float h;
+void g_collide_many(int count, const ac_vec4_t *p1, const ac_vec4_t *p2,
+					ac_vec4_t *hits, float *fracs) {
+	g_collide_batch_t b;
+	const int blocks = (count + COLLIDE_BLOCK - 1) / COLLIDE_BLOCK;
 	int i;
-	// bisect for at most 4 steps or until a solution within 10cm is found
-	for (i = 0; i < 4; i++) {
-		v = ac_vec_mul(v, half);
-		p = ac_vec_add(p1, v);
-		h = g_sample_height(p.f[0], p.f[2]);
-		if (fabs(p.f[1] - h) < 0.1)
-			break;
-		if (p.f[1] < h) {
-			p2 = ac_vec_add(p1, v);
 
-		} else
-			p1 = ac_vec_add(p1, v);
-	}
-	p.f[1] = h;
-	return p;
+	b.p1 = p1;
+	b.p2 = p2;
+	b.hits = hits;
+	b.fracs = fracs;
+	b.count = count;
+	b.ceiling = g_collision_ceiling();
+	// the traces only read the world, so the blocks are independent; a
+	// streamed heightmap may only be accessed from one thread, though
+	if (blocks < COLLIDE_MIN_BLOCKS || !gen_heightmap) {
+		for (i = 0; i < blocks; i++)
+			g_collide_block(&b, i);
+	} else
+		ac_jobs_run(blocks, 1, g_collide_block, &b, NULL);
 }
 
 ac_vec4_t g_collide(ac_vec4_t p1, ac_vec4_t p2) {
-	float frac = g_collide_bldgs(p1, p2, gen_proptree, 1.f);
-	// clip the trace to the terrain first
-	p2 = g_collide_terrain(p1, p2);
-	if (frac < 1.f) {
-		// TODO
-	}
-	return p2;
+	ac_vec4_t hit;
+
+	g_collide_many(1, &p1, &p2, &hit, NULL);
+	return hit;
 }
@@ -7,6 +7,7 @@
 #define G_LOCAL_H
 
 #include "../ac130.h"
+#include "../ac_jobs.h"
 
 /// \file g_local.h
 /// \brief Private interfaces to all game logic modules.
@@ -72,6 +73,11 @@ typedef struct {
 /// Amount of rumble falling off per second
 #define RUMBLE_FALLOFF		2.0
 
+/// Radius of the crater left by a M102 shell, in metres.
+#define CRATER_RADIUS		4.0
+/// Depth of the crater left by a M102 shell in its centre, in metres.
+#define CRATER_DEPTH		1.5
+
 // main game module
 float g_sample_height(float x, float y);
 
@@ -79,6 +85,18 @@ float g_sample_height(float x, float y);
 /// \brief Performs a ray trace from \e p1 to \e p2.
 /// \return		the point hit by the trace
 ac_vec4_t g_collide(ac_vec4_t p1, ac_vec4_t p2);
+/// \brief Performs ray traces for a whole batch of segments.
+/// The traces find the closest hit against both the terrain and the buildings.
+/// Large batches are split across the worker threads, unless the heightmap is
+/// streamed.
+/// \param count	number of segments
+/// \param p1		starts of the segments in heightmap coordinates
+/// \param p2		ends of the segments in heightmap coordinates
+/// \param hits		array to store the points hit in; \e p2 if nothing is hit
+/// \param fracs	array to store the fractions of the segments at the hits
+///					in, 1 if nothing is hit; may be NULL
+void g_collide_many(int count, const ac_vec4_t *p1, const ac_vec4_t *p2,
+					ac_vec4_t *hits, float *fracs);
 
 /// @}
 
@@ -42,32 +42,128 @@ float			g_neg_time = 0.f;
 
 float			g_expl_time = -EXPLOSION_TIME;
 
-bool g_init(void) {
+/// World loading stages, in the order they are completed in.
+typedef enum {
+	LOAD_STARTED,
+	LOAD_RESOURCES,		///< renderer resources generated
+	LOAD_TERRAIN,		///< heightmap generated
+	LOAD_DONE			///< prop lists generated, world saved
+} g_load_stage_t;
+
+/// \brief Minimum time between loading screen frames in milliseconds.
+/// Keeps the main thread from taking CPU time away from the generator.
+#define LOADING_FRAME_TIME	33
+
+static SDL_atomic_t	g_load_stage;		///< last \ref g_load_stage_t completed
+static SDL_atomic_t	g_load_progress;	///< \ref g_loading_tick count
+static int			g_load_ticks;		///< expected \ref g_loading_tick count
+
+/// Generates the game world; runs on the loading thread.
+static int g_load_world(void *unused) {
+	(void)unused;	// shut up compiler
+
+	r_generate_resources();
+	SDL_AtomicSet(&g_load_stage, LOAD_RESOURCES);
+
 	// set new terrain heightmap
-	gen_terrain(0xDEADBEEF);
-	r_set_heightmap();
+	gen_terrain(m_seed);
+	SDL_AtomicSet(&g_load_stage, LOAD_TERRAIN);
 
 	// generate proplists
 	g_trees = malloc(sizeof(*g_trees) * MAX_NUM_TREES);
 	g_bldgs = malloc(sizeof(*g_bldgs) * MAX_NUM_BLDGS);
 	gen_proplists(&g_num_trees, g_trees, &g_num_bldgs, g_bldgs);
 
+	// store whatever had to be generated for the next run
+	gen_save_world();
+
 	// final tick before game is ready
 	g_loading_tick();
+	SDL_AtomicSet(&g_load_stage, LOAD_DONE);
+	return 0;
+}
 
-	g_gravity = ac_vec_set(0, -9.81, 0, 0);
+static void g_draw_loading_screen(void);
+
+/// \brief Loads the world of \ref m_seed, drawing the loading screen meanwhile.
+/// The world cache must already be open (see \ref gen_open_world).
+static void g_load(void) {
+	SDL_Thread *thread;
+	Uint32 frameStart, elapsed;
+	int stage, uploaded = LOAD_STARTED;
+
+	SDL_AtomicSet(&g_load_stage, LOAD_STARTED);
+	SDL_AtomicSet(&g_load_progress, 0);
+	// whatever comes from the cache doesn't take any time, so only count what
+	// needs generating, plus the final tick
+	g_load_ticks = gen_load_ticks() + 1;
+	thread = SDL_CreateThread(g_load_world, "g_load", NULL);
+	if (!thread) {
+		// no loading screen, then
+		fprintf(stderr, "Unable to start loading thread, loading serially\n");
+		g_load_world(NULL);
+	}
+
+	// the generator never waits for us, so draw at our own pace and pick up
+	// the finished stages as we go
+	for (;;) {
+		frameStart = SDL_GetTicks();
+		stage = SDL_AtomicGet(&g_load_stage);
+		if (uploaded < LOAD_RESOURCES && stage >= LOAD_RESOURCES)
+			r_upload_resources();
+		if (uploaded < LOAD_TERRAIN && stage >= LOAD_TERRAIN)
+			r_set_heightmap();
+		uploaded = stage;
+		if (stage == LOAD_DONE)
+			break;
+
+		// keep the window responsive; whatever happened will be handled by
+		// the main loop
+		SDL_PumpEvents();
+		g_draw_loading_screen();
+		elapsed = SDL_GetTicks() - frameStart;
+		if (elapsed < LOADING_FRAME_TIME)
+			SDL_Delay(LOADING_FRAME_TIME - elapsed);
+	}
+	if (thread)
+		SDL_WaitThread(thread, NULL);
 
 	memset(g_projs, 0, sizeof(g_projs));
+	g_nprojs = 0;
 	memset(g_particles, 0, sizeof(g_particles));
+	g_nparticles = 0;
 
 	g_viewpoint.angles[0] = M_PI * 0.5;
 	g_viewpoint.angles[1] = M_PI * -0.17;
+}
+
+bool g_init(void) {
+	g_load();
+	g_gravity = ac_vec_set(0, -9.81, 0, 0);
 	return true;
 }
 
+void g_switch_world(int seed) {
+	// drop the current world; the renderer keeps its own copies of whatever
+	// it needs until the new one replaces them
+	free(g_trees);
+	free(g_bldgs);
+	g_trees = NULL;
+	g_bldgs = NULL;
+	g_num_trees = g_num_bldgs = 0;
+	gen_free_proptree();
+	gen_free_terrain();
+
+	// if the world pool has been here first, this only maps its cache file
+	m_seed = seed;
+	gen_open_world(seed);
+	g_load();
+}
+
 void g_shutdown(void) {
 	free(g_trees);
 	free(g_bldgs);
+	gen_free_terrain();
 }
 
 float g_sample_height(float x, float y) {
@@ -86,10 +182,11 @@ float g_sample_height(float x, float y) {
 		return 0.f;
 
 	// bilinear filtering
-	fR1 = (1.f - xfrac) * gen_heightmap[yi * HEIGHTMAP_SIZE + xi]
-		+ xfrac * gen_heightmap[yi * HEIGHTMAP_SIZE + xi + 1];
-	fR2 = (1.f - xfrac) * gen_heightmap[(yi + 1) * HEIGHTMAP_SIZE + xi]
-		+ xfrac * gen_heightmap[(yi + 1) * HEIGHTMAP_SIZE + xi + 1];
+	// never stall the frame waiting for the streamed terrain
+	fR1 = (1.f - xfrac) * gen_height_approx(xi, yi)
+		+ xfrac * gen_height_approx(xi + 1, yi);
+	fR2 = (1.f - xfrac) * gen_height_approx(xi, yi + 1)
+		+ xfrac * gen_height_approx(xi + 1, yi + 1);
 	return ((1.f - yfrac) * fR1 + yfrac * fR2) * HEIGHT_SCALE;
 }
 
@@ -239,6 +336,7 @@ void g_explode(ac_vec4_t pos, weap_t w) {
 	size_t i, j;
 	particle_t *p;
 	ac_vec4_t dir;
+	float x, y;
 
 	switch (w) {
 		case WP_M61:
@@ -300,6 +398,12 @@ void g_explode(ac_vec4_t pos, weap_t w) {
 			break;
 		case WP_M102:
 			g_expl_time = g_time;
+			// shells bursting on the ground leave a crater behind; the ones
+			// that have hit a rooftop don't
+			x = pos.f[0] + HEIGHTMAP_SIZE / 2;
+			y = pos.f[2] + HEIGHTMAP_SIZE / 2;
+			if (pos.f[1] - g_sample_height(x, y) < CRATER_RADIUS)
+				gen_crater(x, y, CRATER_RADIUS, CRATER_DEPTH);
 			pos = ac_vec_add(pos, ac_vec_set(0, 6, 0, 0));
 			for (i = 0, j = 0, p = g_particles;
 				i < sizeof(g_particles) / sizeof(g_particles[0]) && j < 36;
@@ -336,13 +440,20 @@ void g_explode(ac_vec4_t pos, weap_t w) {
 	}
 }
 
+// projectile motion segments, traced as a single batch
+static projectile_t	*g_seg_projs[MAX_PROJECTILES];
+static ac_vec4_t	g_seg_starts[MAX_PROJECTILES];
+static ac_vec4_t	g_seg_ends[MAX_PROJECTILES];
+static ac_vec4_t	g_seg_hits[MAX_PROJECTILES];
+static float		g_seg_fracs[MAX_PROJECTILES];
+
 void g_advance_projectiles(void) {
 	size_t cnt;
+	int i, nsegs = 0;
 	projectile_t *p;
 	ac_vec4_t grav = ac_vec_mul(g_gravity, g_frameTimeVec);
-	ac_vec4_t npos, ip;
+	ac_vec4_t npos;
 	ac_vec4_t ofs = ac_vec_set(HEIGHTMAP_SIZE / 2, 0, HEIGHTMAP_SIZE / 2, 0);
-	float h;
 
 	for (p = g_projs, cnt = 0;
 		p < g_projs + sizeof(g_projs) / sizeof(g_projs[0]) && cnt < g_nprojs;
@@ -365,14 +476,25 @@ void g_advance_projectiles(void) {
 			g_nprojs--;
 			continue;
 		}
-		// terrain collision detection
-		h = g_sample_height(npos.f[0], npos.f[2]);
-		if (npos.f[1] < h) {
-			// find the impact point
-			ip = g_collide(ac_vec_add(ofs, p->pos), npos);
-			//printf("HIT! %f %f %f\n", ip.f[0], ip.f[1], ip.f[2]);
-			g_explode(ac_vec_sub(ip, ofs), p->weap);
+		g_seg_projs[nsegs] = p;
+		g_seg_starts[nsegs] = ac_vec_add(ofs, p->pos);
+		g_seg_ends[nsegs] = npos;
+		nsegs++;
+	}
+
+	// collision detection for all the projectiles at once
+	g_collide_many(nsegs, g_seg_starts, g_seg_ends, g_seg_hits, g_seg_fracs);
+
+	for (i = 0; i < nsegs; i++) {
+		p = g_seg_projs[i];
+		npos = g_seg_ends[i];
+		// rounds that have somehow got under the surface go off, too
+		if (g_seg_fracs[i] < 1.f
+			|| npos.f[1] < g_sample_height(npos.f[0], npos.f[2])) {
+			g_explode(ac_vec_sub(g_seg_hits[i], ofs), p->weap);
 			p->weap = WP_NONE;
+			g_nprojs--;
+			continue;
 		}
 		p->pos = ac_vec_sub(npos, ofs);
 		// draw tracers
@@ -688,17 +810,20 @@ void g_draw_instructions(void) {
 		"marked by a flashing IR strobe!", 0.02, 0.56, 0.55);
 }
 
-#define TOTAL_TICKS	6410.f
-void g_loading_tick() {
+void g_loading_tick(void) {
+	SDL_AtomicAdd(&g_load_progress, 1);
+}
+
+static void g_draw_loading_screen(void) {
 	static char buf[32];
 	static float pts[][2] = {
 		{0.25, 0.97}, {0.25, 0.97}
 	};
-	static int counter = 0;
-	counter++;
-	// don't need update the screen every damn tick
-	if (counter % 100 != 1)
-		return;
+	float progress = SDL_AtomicGet(&g_load_progress) / (float)g_load_ticks;
+
+	if (progress > 1.f)
+		progress = 1.f;
+
 	r_start_scene(0, NULL);
 	r_finish_fx();
 	r_finish_3D();
@@ -706,10 +831,10 @@ void g_loading_tick() {
 	// draw the instructions
 	g_draw_instructions();
 	// draw the progress bar
-	pts[1][0] = 0.25 + 0.5 * (float)counter / TOTAL_TICKS;
+	pts[1][0] = 0.25 + 0.5 * progress;
 	r_draw_lines(pts, 2, 12.f);
 	// draw percentage
-	sprintf(buf, "LOADING - %.0f%%", (float)counter / TOTAL_TICKS * 100.f);
+	sprintf(buf, "LOADING - %.0f%%", progress * 100.f);
 	r_draw_string(buf, 0.25, 0.87, 1.0);
 	r_draw_string("(C) 2010, Leszek Godlewski - www.inequation.org",
 		-0.995, 0.005, 0.3);
@@ -719,6 +844,9 @@ void g_loading_tick() {
 }
 
 #define FLOATING_RADIUS		200.f
+/// radius of the terrain area to keep resident around the viewpoint; covers
+/// everything visible at the shallowest camera pitch
+#define STREAM_RADIUS		(4.f * FLOATING_RADIUS)
 #define TIME_SCALE			-0.04
 #define MOUSE_SCALE			0.001
 void g_viewpoint_think(ac_input_t *input) {
@@ -821,6 +949,10 @@ void g_frame(int ticks, float frameTime, ac_input_t *input) {
 	// advance the viewpoint
 	g_viewpoint_think(input);
 
+	// keep the terrain we're looking at in memory
+	gen_stream_update(g_viewpoint.origin.f[0], g_viewpoint.origin.f[2],
+		STREAM_RADIUS);
+
 	// operate the weapons
 	g_player_think(input);
 
@@ -0,0 +1,627 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// World cache module; memory-mapped, versioned storage of generated content
+
+#include "gen_local.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+/// Cache file magic number.
+#define GEN_CACHE_MAGIC			GEN_FOURCC('A', 'C', 'W', 'C')
+/// \brief Cache file format version.
+/// Version 1 was a raw heightmap dump without any header, version 2 had no
+/// flags, version 3 stored the prop tree nodes with full AABBs and explicit
+/// child indices, version 4 had no prop counts in the leaves, version 5 had no
+/// packed sections.
+#define GEN_CACHE_VERSION		6
+/// Maximum number of sections in a cache file.
+#define GEN_CACHE_MAX_SECTIONS	16
+/// Alignment of section data within the file.
+#define GEN_CACHE_ALIGN			64
+/// Header flag: the world was generated with the legacy random numbers.
+#define GEN_CACHE_LEGACY_RNG	(1 << 0)
+
+/// Cache file header.
+typedef struct {
+	Uint32	magic;			///< \ref GEN_CACHE_MAGIC
+	Uint32	version;		///< \ref GEN_CACHE_VERSION
+	Uint32	mapSize;		///< \ref HEIGHTMAP_SIZE the file was written with
+	Uint32	seed;			///< world seed
+	Uint32	revision;		///< \ref GEN_REVISION the file was written with
+	Uint32	numSections;	///< number of entries in the section table
+	Uint32	crc;			///< CRC-32 of the header (with this field zeroed)
+							///  and the section table
+	Uint32	flags;			///< GEN_CACHE_* flags the file was written with
+} gen_cache_header_t;
+
+/// Section codecs.
+enum {
+	GEN_CODEC_RAW,		///< stored as it is
+	GEN_CODEC_PACKED	///< packed by \ref gen_pack
+};
+
+/// Cache file section table entry.
+typedef struct {
+	Uint32	id;				///< section identifier (see \ref GEN_FOURCC)
+	Uint32	crc;			///< CRC-32 of the section data, as stored
+	Uint64	offset;			///< offset of the data from the start of file
+	Uint64	size;			///< size of the stored data in bytes
+	Uint64	rawSize;		///< size of the data once unpacked
+	Uint32	codec;			///< GEN_CODEC_*
+	Uint32	reserved;
+} gen_cache_entry_t;
+
+/// Section queued for writing.
+typedef struct {
+	Uint32		id;
+	void		*data;		///< private copy of the data, as stored
+	size_t		size;
+	size_t		rawSize;
+	Uint32		codec;
+} gen_cache_pending_t;
+
+/// Cache file, either of a world or of the shared assets.
+typedef struct {
+	bool						open;	///< true if the file has been selected
+	int							seed;	///< seed the file is opened for
+	Uint32						mapSize;	///< expected heightmap size
+	Uint32						flags;	///< expected GEN_CACHE_* flags
+	char						name[32];	///< file name
+	uchar						*base;	///< mapped file, NULL if none
+	size_t						size;	///< size of the mapping
+#ifdef WIN32
+	HANDLE						file;
+	HANDLE						mapping;
+#endif
+	const gen_cache_header_t	*hdr;
+	const gen_cache_entry_t		*table;
+	/// unpacked copies of the packed sections, by table index
+	void						*unpacked[GEN_CACHE_MAX_SECTIONS];
+	/// sections whose checksums have been verified, by table index
+	bool						verified[GEN_CACHE_MAX_SECTIONS];
+	/// sections whose checksums didn't match, by table index
+	bool						corrupt[GEN_CACHE_MAX_SECTIONS];
+	gen_cache_pending_t			pending[GEN_CACHE_MAX_SECTIONS];
+	int							numPending;
+} gen_cache_file_t;
+
+bool					gen_cache_packing = false;
+/// False to neither read nor write any cache files.
+static bool				gen_caching = true;
+/// Cache of the current world.
+static gen_cache_file_t	gen_cache;
+/// \brief Cache of the assets that don't depend on the world.
+/// Uses the same format as the world caches, with the seed, the heightmap size
+/// and the flags all set to 0.
+static gen_cache_file_t	gen_assets;
+
+/// Name of the asset cache file.
+#define GEN_ASSET_NAME			"assets.act"
+
+/// Returns the header flags matching the current generator settings.
+static Uint32 gen_cache_flags(void) {
+	return gen_legacy_rng ? GEN_CACHE_LEGACY_RNG : 0;
+}
+
+/// Reads a little-endian 32-bit word.
+static inline Uint32 gen_read32(const uchar *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((Uint32)p[3] << 24);
+}
+
+Uint32 gen_crc32(Uint32 crc, const void *data, size_t size) {
+	// slicing-by-8: table[k][b] is the CRC of byte b followed by k zero bytes,
+	// so 8 bytes are folded in with 8 independent lookups
+	static Uint32 table[8][256];
+	const uchar *p = data;
+	Uint32 c, a, b;
+	int i, j;
+
+	if (!table[7][1]) {
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			table[0][i] = c;
+		}
+		for (j = 1; j < 8; j++) {
+			for (i = 0; i < 256; i++) {
+				c = table[j - 1][i];
+				table[j][i] = table[0][c & 0xFF] ^ (c >> 8);
+			}
+		}
+	}
+
+	crc = ~crc;
+	for (; size >= 8; size -= 8, p += 8) {
+		a = crc ^ gen_read32(p);
+		b = gen_read32(p + 4);
+		crc = table[7][a & 0xFF] ^ table[6][(a >> 8) & 0xFF]
+			^ table[5][(a >> 16) & 0xFF] ^ table[4][a >> 24]
+			^ table[3][b & 0xFF] ^ table[2][(b >> 8) & 0xFF]
+			^ table[1][(b >> 16) & 0xFF] ^ table[0][b >> 24];
+	}
+	while (size--)
+		crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/// Maps the entire file into memory as a private, copy-on-write mapping.
+static bool gen_cache_map(gen_cache_file_t *c) {
+#ifdef WIN32
+	LARGE_INTEGER size;
+
+	c->file = CreateFileA(c->name, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (c->file == INVALID_HANDLE_VALUE)
+		return false;
+	if (!GetFileSizeEx(c->file, &size)
+		|| size.QuadPart < (LONGLONG)sizeof(gen_cache_header_t)) {
+		CloseHandle(c->file);
+		return false;
+	}
+	c->mapping = CreateFileMappingA(c->file, NULL,
+		PAGE_WRITECOPY, 0, 0, NULL);
+	if (!c->mapping) {
+		CloseHandle(c->file);
+		return false;
+	}
+	c->base = MapViewOfFile(c->mapping, FILE_MAP_COPY, 0, 0, 0);
+	if (!c->base) {
+		CloseHandle(c->mapping);
+		CloseHandle(c->file);
+		return false;
+	}
+	c->size = size.QuadPart;
+#else
+	struct stat st;
+	void *p;
+	int fd;
+
+	fd = open(c->name, O_RDONLY);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(gen_cache_header_t)) {
+		close(fd);
+		return false;
+	}
+	// private mapping, so that the game may modify the data in memory
+	p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	// the mapping holds its own reference to the file
+	close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	c->base = p;
+	c->size = st.st_size;
+#endif
+	return true;
+}
+
+/// Unmaps the cache file, if any.
+static void gen_cache_unmap(gen_cache_file_t *c) {
+	int i;
+
+	for (i = 0; i < GEN_CACHE_MAX_SECTIONS; i++) {
+		free(c->unpacked[i]);
+		c->unpacked[i] = NULL;
+		c->verified[i] = false;
+		c->corrupt[i] = false;
+	}
+	if (c->base) {
+#ifdef WIN32
+		UnmapViewOfFile(c->base);
+		CloseHandle(c->mapping);
+		CloseHandle(c->file);
+#else
+		munmap(c->base, c->size);
+#endif
+	}
+	c->base = NULL;
+	c->size = 0;
+	c->hdr = NULL;
+	c->table = NULL;
+}
+
+/// \brief Validates the mapped file; returns the reason for rejection or NULL
+/// if OK.
+/// Only the header and the section table are checked here; the section data
+/// is checked on first use by \ref gen_cache_verify, so that opening the file
+/// doesn't read all of it.
+static const char *gen_cache_validate(const gen_cache_file_t *c) {
+	gen_cache_header_t hdr;
+	const gen_cache_entry_t *e;
+	Uint32 crc;
+	uint i;
+
+	memcpy(&hdr, c->base, sizeof(hdr));
+	if (hdr.magic != GEN_CACHE_MAGIC)
+		return "unknown format";
+	if (hdr.version != GEN_CACHE_VERSION)
+		return "format version mismatch";
+	if (hdr.mapSize != c->mapSize)
+		return "heightmap size mismatch";
+	if (hdr.seed != (Uint32)c->seed)
+		return "seed mismatch";
+	if (hdr.revision != GEN_REVISION)
+		return "generator revision mismatch";
+	if (hdr.flags != c->flags)
+		return "random number generator mismatch";
+	if (hdr.numSections > GEN_CACHE_MAX_SECTIONS
+		|| sizeof(hdr) + hdr.numSections * sizeof(*e) > c->size)
+		return "truncated section table";
+	e = (const gen_cache_entry_t *)(c->base + sizeof(hdr));
+	crc = hdr.crc;
+	hdr.crc = 0;
+	if (gen_crc32(gen_crc32(0, &hdr, sizeof(hdr)), e,
+		hdr.numSections * sizeof(*e)) != crc)
+		return "header checksum mismatch";
+	for (i = 0; i < hdr.numSections; i++, e++) {
+		if (e->offset > c->size || e->size > c->size - e->offset)
+			return "truncated section";
+		if (e->codec > GEN_CODEC_PACKED
+			|| (e->codec == GEN_CODEC_RAW && e->rawSize != e->size))
+			return "unknown section codec";
+	}
+	return NULL;
+}
+
+/// Maps and validates the given cache file.
+static bool gen_cache_file_open(gen_cache_file_t *c, const char *kind) {
+	const char *reason;
+
+	c->open = true;
+	if (!gen_cache_map(c))
+		return false;
+	if ((reason = gen_cache_validate(c)) != NULL) {
+		printf("Ignoring stale %s cache %s: %s\n", kind, c->name, reason);
+		gen_cache_unmap(c);
+		return false;
+	}
+	c->hdr = (const gen_cache_header_t *)c->base;
+	c->table = (const gen_cache_entry_t *)(c->hdr + 1);
+	return true;
+}
+
+void gen_set_cache_packing(bool pack) {
+	gen_cache_packing = pack;
+}
+
+void gen_set_caching(bool enable) {
+	gen_cache_close();
+	gen_asset_close();
+	gen_caching = enable;
+}
+
+/// Builds the name of the cache file of the given seed.
+static void gen_cache_name(char *name, size_t size, int seed) {
+	snprintf(name, size, "%X_%d.act", *((uint *)&seed), HEIGHTMAP_SIZE);
+}
+
+/// Builds the name of the temporary file the given process writes a cache
+/// file into.
+static void gen_cache_temp_name(char *tmpname, size_t size, const char *name,
+	unsigned long pid) {
+	snprintf(tmpname, size, "%s.%lu.tmp", name, pid);
+}
+
+bool gen_cache_open(int seed) {
+	gen_cache_file_t *c = &gen_cache;
+
+	if (c->open && c->seed == seed)
+		return c->base != NULL;
+
+	gen_cache_close();
+	if (!gen_caching)
+		return false;
+	c->seed = seed;
+	c->mapSize = HEIGHTMAP_SIZE;
+	c->flags = gen_cache_flags();
+	gen_cache_name(c->name, sizeof(c->name), seed);
+	return gen_cache_file_open(c, "world");
+}
+
+void gen_cache_remove_temp(int seed, unsigned long pid) {
+	char name[32], tmpname[64];
+
+	gen_cache_name(name, sizeof(name), seed);
+	gen_cache_temp_name(tmpname, sizeof(tmpname), name, pid);
+	remove(tmpname);
+	gen_cache_temp_name(tmpname, sizeof(tmpname), GEN_ASSET_NAME, pid);
+	remove(tmpname);
+}
+
+/// Returns the section table entry of the given section in the mapped file.
+static const gen_cache_entry_t *gen_cache_find(const gen_cache_file_t *c,
+	Uint32 id) {
+	uint i;
+	if (!c->base)
+		return NULL;
+	for (i = 0; i < c->hdr->numSections; i++) {
+		if (c->table[i].id == id)
+			return &c->table[i];
+	}
+	return NULL;
+}
+
+/// \brief Checks the data of the given section against its checksum.
+/// The check is only run once per section; subsequent calls return the cached
+/// result.
+/// \param i		table index of the section
+/// \return			false if the data doesn't match the checksum
+static bool gen_cache_verify(gen_cache_file_t *c, int i) {
+	const gen_cache_entry_t *e = &c->table[i];
+
+	if (!c->verified[i]) {
+		c->verified[i] = true;
+		c->corrupt[i] =
+			gen_crc32(0, c->base + e->offset, e->size) != e->crc;
+		if (c->corrupt[i])
+			printf("Ignoring corrupt section %.4s of cache %s\n",
+				(const char *)&e->id, c->name);
+	}
+	return !c->corrupt[i];
+}
+
+/// Returns the data of the given section if its size matches, unpacking it
+/// on first use.
+static void *gen_cache_file_get(gen_cache_file_t *c, Uint32 id,
+	size_t size) {
+	const gen_cache_entry_t *e = gen_cache_find(c, id);
+	int i;
+
+	if (!e || e->rawSize != size)
+		return NULL;
+	i = e - c->table;
+	if (!gen_cache_verify(c, i))
+		return NULL;
+	if (e->codec == GEN_CODEC_RAW)
+		return c->base + e->offset;
+	if (!c->unpacked[i] && (c->unpacked[i] = malloc(size ? size : 1))
+		&& !gen_unpack(c->base + e->offset, e->size, c->unpacked[i], size)) {
+		free(c->unpacked[i]);
+		c->unpacked[i] = NULL;
+	}
+	return c->unpacked[i];
+}
+
+void *gen_cache_get(Uint32 id, size_t size) {
+	return gen_cache_file_get(&gen_cache, id, size);
+}
+
+size_t gen_cache_size(Uint32 id) {
+	const gen_cache_entry_t *e = gen_cache_find(&gen_cache, id);
+	return e ? e->rawSize : 0;
+}
+
+bool gen_cache_packed(Uint32 id) {
+	const gen_cache_entry_t *e = gen_cache_find(&gen_cache, id);
+	return e && e->codec != GEN_CODEC_RAW;
+}
+
+/// Drops all the sections queued for writing.
+static void gen_cache_drop_pending(gen_cache_file_t *c) {
+	int i;
+	for (i = 0; i < c->numPending; i++)
+		free(c->pending[i].data);
+	c->numPending = 0;
+}
+
+/// Unmaps the given cache file and drops its queued sections.
+static void gen_cache_file_close(gen_cache_file_t *c) {
+	gen_cache_unmap(c);
+	gen_cache_drop_pending(c);
+	c->open = false;
+}
+
+void gen_cache_close(void) {
+	gen_cache_file_close(&gen_cache);
+}
+
+/// \brief Queues a section of the given cache file for writing.
+/// \param stride	see \ref gen_pack; 0 to store the section as it is
+static void gen_cache_file_put(gen_cache_file_t *c, Uint32 id,
+	const void *data, size_t size, int stride, int pitch) {
+	void *copy;
+	size_t stored = size;
+	Uint32 codec = GEN_CODEC_RAW;
+	int i;
+
+	if (!c->open)
+		return;
+	// replace the section if it's already been queued
+	for (i = 0; i < c->numPending; i++) {
+		if (c->pending[i].id == id)
+			break;
+	}
+	assert(i < GEN_CACHE_MAX_SECTIONS);
+	if (i >= GEN_CACHE_MAX_SECTIONS)
+		return;
+	if (stride > 0 && gen_cache_packing
+		&& (stored = gen_pack(data, size, stride, pitch, &copy)) > 0)
+		codec = GEN_CODEC_PACKED;
+	else {
+		// not worth packing
+		stored = size;
+		if (!(copy = malloc(size ? size : 1)))
+			return;
+		memcpy(copy, data, size);
+	}
+	if (i == c->numPending)
+		c->numPending++;
+	else
+		free(c->pending[i].data);
+	c->pending[i].id = id;
+	c->pending[i].data = copy;
+	c->pending[i].size = stored;
+	c->pending[i].rawSize = size;
+	c->pending[i].codec = codec;
+}
+
+void gen_cache_put(Uint32 id, const void *data, size_t size) {
+	gen_cache_file_put(&gen_cache, id, data, size, 0, 0);
+}
+
+void gen_cache_put_packed(Uint32 id, const void *data, size_t size,
+	int stride, int pitch) {
+	gen_cache_file_put(&gen_cache, id, data, size, stride, pitch);
+}
+
+/// Writes padding to bring the file position up to the section alignment.
+static bool gen_cache_pad(FILE *f, Uint64 *pos) {
+	static const uchar zeros[GEN_CACHE_ALIGN];
+	size_t pad = (GEN_CACHE_ALIGN - *pos % GEN_CACHE_ALIGN) % GEN_CACHE_ALIGN;
+	*pos += pad;
+	return fwrite(zeros, 1, pad, f) == pad;
+}
+
+/// Writes the queued sections of the given cache file.
+static bool gen_cache_file_flush(gen_cache_file_t *c) {
+	gen_cache_header_t hdr;
+	gen_cache_entry_t table[GEN_CACHE_MAX_SECTIONS];
+	const void *data[GEN_CACHE_MAX_SECTIONS];
+	char tmpname[64];
+	Uint64 pos;
+	FILE *f;
+	bool ok = true;
+	int i, j, num;
+
+	if (!c->open || c->numPending < 1)
+		return true;
+
+	// gather the new sections, and keep those of the old file that haven't
+	// been replaced
+	memset(table, 0, sizeof(table));
+	for (num = 0; num < c->numPending; num++) {
+		table[num].id = c->pending[num].id;
+		table[num].size = c->pending[num].size;
+		table[num].rawSize = c->pending[num].rawSize;
+		table[num].codec = c->pending[num].codec;
+		table[num].crc = gen_crc32(0, c->pending[num].data,
+			c->pending[num].size);
+		data[num] = c->pending[num].data;
+	}
+	for (i = 0; c->base && i < (int)c->hdr->numSections; i++) {
+		for (j = 0; j < c->numPending; j++) {
+			if (c->pending[j].id == c->table[i].id)
+				break;
+		}
+		if (j < c->numPending || num >= GEN_CACHE_MAX_SECTIONS
+			|| c->corrupt[i])
+			continue;
+		// carried over as stored, along with the stored checksum, so that
+		// sections that have never been verified still get caught later
+		table[num].id = c->table[i].id;
+		table[num].crc = c->table[i].crc;
+		table[num].size = c->table[i].size;
+		table[num].rawSize = c->table[i].rawSize;
+		table[num].codec = c->table[i].codec;
+		data[num++] = c->base + c->table[i].offset;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = GEN_CACHE_MAGIC;
+	hdr.version = GEN_CACHE_VERSION;
+	hdr.mapSize = c->mapSize;
+	hdr.seed = c->seed;
+	hdr.revision = GEN_REVISION;
+	hdr.numSections = num;
+	hdr.flags = c->flags;
+
+	// lay the sections out
+	pos = sizeof(hdr) + hdr.numSections * sizeof(table[0]);
+	for (i = 0; i < num; i++) {
+		pos += (GEN_CACHE_ALIGN - pos % GEN_CACHE_ALIGN) % GEN_CACHE_ALIGN;
+		table[i].offset = pos;
+		pos += table[i].size;
+	}
+	hdr.crc = gen_crc32(gen_crc32(0, &hdr, sizeof(hdr)), table,
+		hdr.numSections * sizeof(table[0]));
+
+	// write to a temporary file first, so that other instances of the game
+	// never see a partially written cache; it's named after the process, so
+	// that instances writing the same cache don't write into each other's
+#ifdef WIN32
+	gen_cache_temp_name(tmpname, sizeof(tmpname), c->name,
+		GetCurrentProcessId());
+#else
+	gen_cache_temp_name(tmpname, sizeof(tmpname), c->name, getpid());
+#endif
+	f = fopen(tmpname, "wb");
+	if (!f) {
+		gen_cache_drop_pending(c);
+		return false;
+	}
+	ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1
+		&& fwrite(table, sizeof(table[0]), hdr.numSections, f)
+			== hdr.numSections;
+	pos = sizeof(hdr) + hdr.numSections * sizeof(table[0]);
+	for (i = 0; ok && i < num; i++) {
+		ok = gen_cache_pad(f, &pos)
+			&& fwrite(data[i], 1, table[i].size, f) == table[i].size;
+		pos += table[i].size;
+	}
+	ok = fclose(f) == 0 && ok;
+	gen_cache_drop_pending(c);
+
+#ifdef WIN32
+	// rename() won't overwrite on Windows; note that this fails while the old
+	// file is still mapped, in which case the old file simply stays in place
+	if (ok)
+		remove(c->name);
+#endif
+	if (!ok || rename(tmpname, c->name)) {
+		remove(tmpname);
+		return false;
+	}
+	return true;
+}
+
+bool gen_cache_flush(void) {
+	return gen_cache_file_flush(&gen_cache);
+}
+
+/// Maps the asset cache on first use.
+static void gen_asset_open(void) {
+	if (gen_assets.open || !gen_caching)
+		return;
+	// all zeros, as the assets are the same for every world
+	gen_assets.seed = 0;
+	gen_assets.mapSize = 0;
+	gen_assets.flags = 0;
+	snprintf(gen_assets.name, sizeof(gen_assets.name), GEN_ASSET_NAME);
+	gen_cache_file_open(&gen_assets, "asset");
+}
+
+void *gen_asset_get(Uint32 id, size_t size) {
+	gen_asset_open();
+	return gen_cache_file_get(&gen_assets, id, size);
+}
+
+size_t gen_asset_size(Uint32 id) {
+	const gen_cache_entry_t *e;
+
+	gen_asset_open();
+	e = gen_cache_find(&gen_assets, id);
+	return e ? e->rawSize : 0;
+}
+
+void gen_asset_put(Uint32 id, const void *data, size_t size) {
+	gen_asset_open();
+	gen_cache_file_put(&gen_assets, id, data, size, 0, 0);
+}
+
+bool gen_asset_flush(void) {
+	return gen_cache_file_flush(&gen_assets);
+}
+
+void gen_asset_close(void) {
+	gen_cache_file_close(&gen_assets);
+}
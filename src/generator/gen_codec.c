@@ -0,0 +1,416 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Cache codec module; lossless compression of cache sections
+
+#include "gen_local.h"
+#include <string.h>
+
+/// Target number of raw bytes in a block; blocks are coded independently.
+#define GEN_CODEC_BLOCK		(64 << 10)
+/// Binary logarithm of the sum of the symbol frequencies of a block.
+#define GEN_RANS_BITS		12
+/// Sum of the symbol frequencies of a block.
+#define GEN_RANS_TOTAL		(1 << GEN_RANS_BITS)
+/// Lower bound of the normalized rANS state.
+#define GEN_RANS_LOW		(1u << 23)
+
+/// Block coding modes.
+enum {
+	GEN_BLOCK_STORED,	///< residuals stored as they are
+	GEN_BLOCK_RANS		///< residuals coded with rANS
+};
+
+/// Packed data header.
+typedef struct {
+	Uint32	stride;		///< bytes between an element and the one to its left
+	Uint32	pitch;		///< bytes between rows, 0 for 1D data
+	Uint32	blockSize;	///< raw bytes per block (except for the last one)
+	Uint32	numBlocks;
+	// followed by numBlocks Uint32 offsets of the block ends, counted from
+	// the end of the offset table, and the blocks themselves
+} gen_packed_header_t;
+
+/// Block header.
+typedef struct {
+	Uint32	mode;					///< GEN_BLOCK_*
+	Uint16	freq[256];				///< symbol frequencies for rANS
+} gen_block_header_t;
+
+/// Block job context.
+typedef struct {
+	const uchar			*raw;
+	uchar				*out;		///< one buffer per block when packing
+	uchar				*res;		///< residuals of all blocks when packing
+	size_t				size;
+	size_t				outMax;		///< size of a single output buffer
+	gen_packed_header_t	hdr;
+	const uchar			*blocks;	///< start of the blocks when unpacking
+	const Uint32		*ends;		///< offsets of the block ends
+	size_t				packedSize;	///< size of the block area
+	Uint32				*outSizes;	///< packed size of every block
+	SDL_atomic_t		failed;
+} gen_codec_job_t;
+
+/// \brief LOCO-I median edge detector; predicts a texel from its neighbours.
+/// The median of left, up and left + up - upLeft, written as a clamp so that
+/// it compiles to conditional moves.
+static inline uchar gen_med(int left, int up, int upLeft) {
+	const int lo = left < up ? left : up;
+	const int hi = left < up ? up : left;
+	const int grad = left + up - upLeft;
+	return grad < lo ? lo : (grad > hi ? hi : grad);
+}
+
+/// Returns the number of raw bytes in a block.
+static inline size_t gen_block_len(const gen_packed_header_t *h, size_t size,
+									int block) {
+	const size_t start = (size_t)block * h->blockSize;
+	return size - start < h->blockSize ? size - start : h->blockSize;
+}
+
+// the first row of a block is predicted from the left only, the first
+// element of every other row from the one above; the bytes with nothing to be
+// predicted from are predicted as zeroes
+
+/// Computes the prediction residuals of a block.
+static void gen_block_residuals(const gen_packed_header_t *h,
+								const uchar *raw, size_t len, uchar *res) {
+	const size_t rowLen = h->pitch ? h->pitch : len;
+	const size_t s = h->stride;
+	const uchar *row, *prev = NULL;
+	uchar *out;
+	size_t y, x, n;
+
+	for (y = 0; y < len; y += rowLen, prev = row) {
+		n = len - y < rowLen ? len - y : rowLen;
+		row = raw + y;
+		out = res + y;
+		for (x = 0; x < s && x < n; x++)
+			out[x] = row[x] - (prev ? prev[x] : 0);
+		if (!prev) {
+			for (; x < n; x++)
+				out[x] = row[x] - row[x - s];
+		} else {
+			for (; x < n; x++)
+				out[x] = row[x] - gen_med(row[x - s], prev[x], prev[x - s]);
+		}
+	}
+}
+
+/// Reconstructs a block out of its residuals, in place.
+static void gen_block_reconstruct(const gen_packed_header_t *h,
+									uchar *raw, size_t len) {
+	const size_t rowLen = h->pitch ? h->pitch : len;
+	const size_t s = h->stride;
+	const uchar *prev = NULL;
+	uchar *row;
+	size_t y, x, n;
+
+	for (y = 0; y < len; y += rowLen, prev = row) {
+		n = len - y < rowLen ? len - y : rowLen;
+		row = raw + y;
+		for (x = 0; x < s && x < n; x++)
+			row[x] += prev ? prev[x] : 0;
+		if (!prev) {
+			for (; x < n; x++)
+				row[x] += row[x - s];
+		} else {
+			for (; x < n; x++)
+				row[x] += gen_med(row[x - s], prev[x], prev[x - s]);
+		}
+	}
+}
+
+/// Scales the symbol counts of a block to frequencies summing up to
+/// \ref GEN_RANS_TOTAL, keeping every symbol that occurs codable.
+static void gen_normalize_freqs(const Uint32 *counts, size_t total,
+								Uint16 *freq) {
+	int i, sum = 0, largest = 0;
+
+	for (i = 0; i < 256; i++) {
+		if (!counts[i]) {
+			freq[i] = 0;
+			continue;
+		}
+		freq[i] = (Uint64)counts[i] * GEN_RANS_TOTAL / total;
+		if (!freq[i])
+			freq[i] = 1;
+		sum += freq[i];
+		if (counts[i] > counts[largest])
+			largest = i;
+	}
+	// settle the rounding errors on the most frequent symbol, then on any
+	// other that can afford it
+	while (sum != GEN_RANS_TOTAL) {
+		if (sum < GEN_RANS_TOTAL) {
+			freq[largest] += GEN_RANS_TOTAL - sum;
+			sum = GEN_RANS_TOTAL;
+		} else if (freq[largest] > sum - GEN_RANS_TOTAL) {
+			freq[largest] -= sum - GEN_RANS_TOTAL;
+			sum = GEN_RANS_TOTAL;
+		} else {
+			for (i = 0; i < 256 && sum > GEN_RANS_TOTAL; i++) {
+				if (freq[i] > 1) {
+					freq[i]--;
+					sum--;
+				}
+			}
+		}
+	}
+}
+
+/// \brief Codes a block; returns its packed size, 0 if it didn't fit.
+/// Two interleaved rANS states code the even and the odd residuals, which
+/// lets the decoder work on both at once. The residuals are coded backwards,
+/// so that they're decoded forwards.
+static size_t gen_block_pack(const uchar *res, size_t len, uchar *out,
+								size_t outMax) {
+	gen_block_header_t *bh = (gen_block_header_t *)out;
+	Uint32 counts[256] = {0};
+	Uint16 start[256];
+	uchar *end = out + outMax, *p = end;
+	uchar *const limit = out + sizeof(*bh) + 8;
+	Uint32 x[2] = {GEN_RANS_LOW, GEN_RANS_LOW}, f, xMax;
+	size_t i, n;
+	int s;
+
+	if (outMax < sizeof(*bh) + 8)
+		return 0;
+	for (i = 0; i < len; i++)
+		counts[res[i]]++;
+	gen_normalize_freqs(counts, len, bh->freq);
+	for (s = 0, f = 0; s < 256; s++) {
+		start[s] = f;
+		f += bh->freq[s];
+	}
+
+	for (i = len; i-- > 0; ) {
+		s = res[i];
+		f = bh->freq[s];
+		xMax = ((GEN_RANS_LOW >> GEN_RANS_BITS) << 8) * f;
+		while (x[i & 1] >= xMax) {
+			if (p <= limit)
+				return 0;
+			*--p = x[i & 1] & 0xFF;
+			x[i & 1] >>= 8;
+		}
+		x[i & 1] = ((x[i & 1] / f) << GEN_RANS_BITS) + x[i & 1] % f + start[s];
+	}
+	if (p < limit)
+		return 0;
+	p -= 8;
+	memcpy(p, x, 8);
+
+	// move the stream right behind the header
+	n = end - p;
+	bh->mode = GEN_BLOCK_RANS;
+	memmove(out + sizeof(*bh), p, n);
+	return sizeof(*bh) + n;
+}
+
+/// rANS decoding table entry, one per frequency slot.
+typedef struct {
+	Uint16	freq;		///< frequency of the symbol
+	Uint16	bias;		///< offset of the slot from the start of the symbol
+	uchar	sym;
+} gen_rans_slot_t;
+
+/// Decodes the residuals of a block; returns false on malformed input.
+static bool gen_block_unpack(const uchar *in, size_t inSize, uchar *res,
+								size_t len) {
+	gen_block_header_t bh;
+	gen_rans_slot_t slots[GEN_RANS_TOTAL];
+	const gen_rans_slot_t *e0, *e1;
+	const uchar *p, *end = in + inSize;
+	Uint32 x0, x1, sum = 0, i;
+	size_t k;
+	int s;
+
+	if (inSize < sizeof(Uint32))
+		return false;
+	memcpy(&bh.mode, in, sizeof(bh.mode));
+	if (bh.mode == GEN_BLOCK_STORED) {
+		if (inSize != sizeof(Uint32) + len)
+			return false;
+		memcpy(res, in + sizeof(Uint32), len);
+		return true;
+	}
+	if (bh.mode != GEN_BLOCK_RANS || inSize < sizeof(bh) + 8)
+		return false;
+	memcpy(&bh, in, sizeof(bh));
+	for (s = 0; s < 256; s++) {
+		if (sum + bh.freq[s] > GEN_RANS_TOTAL)
+			return false;
+		for (i = 0; i < bh.freq[s]; i++) {
+			slots[sum + i].freq = bh.freq[s];
+			slots[sum + i].bias = i;
+			slots[sum + i].sym = s;
+		}
+		sum += bh.freq[s];
+	}
+	if (sum != GEN_RANS_TOTAL)
+		return false;
+
+	p = in + sizeof(bh);
+	memcpy(&x0, p, 4);
+	memcpy(&x1, p + 4, 4);
+	p += 8;
+	// the renormalization reads at most 2 bytes per symbol, so it only needs
+	// to watch out for the end of the input near the end of it
+	for (k = 0; k + 1 < len && end - p >= 4; k += 2) {
+		e0 = &slots[x0 & (GEN_RANS_TOTAL - 1)];
+		e1 = &slots[x1 & (GEN_RANS_TOTAL - 1)];
+		res[k] = e0->sym;
+		res[k + 1] = e1->sym;
+		x0 = e0->freq * (x0 >> GEN_RANS_BITS) + e0->bias;
+		x1 = e1->freq * (x1 >> GEN_RANS_BITS) + e1->bias;
+		if (x0 < GEN_RANS_LOW) {
+			x0 = (x0 << 8) | *p++;
+			if (x0 < GEN_RANS_LOW)
+				x0 = (x0 << 8) | *p++;
+		}
+		if (x1 < GEN_RANS_LOW) {
+			x1 = (x1 << 8) | *p++;
+			if (x1 < GEN_RANS_LOW)
+				x1 = (x1 << 8) | *p++;
+		}
+	}
+	for (; k < len; k++) {
+		Uint32 *x = k & 1 ? &x1 : &x0;
+		e0 = &slots[*x & (GEN_RANS_TOTAL - 1)];
+		res[k] = e0->sym;
+		*x = e0->freq * (*x >> GEN_RANS_BITS) + e0->bias;
+		while (*x < GEN_RANS_LOW && p < end)
+			*x = (*x << 8) | *p++;
+	}
+	return p == end && x0 == GEN_RANS_LOW && x1 == GEN_RANS_LOW;
+}
+
+/// Packs a single block; the packing job callback.
+static void gen_pack_block(void *ctx, int block) {
+	gen_codec_job_t *j = ctx;
+	const size_t len = gen_block_len(&j->hdr, j->size, block);
+	const uchar *raw = j->raw + (size_t)block * j->hdr.blockSize;
+	uchar *out = j->out + (size_t)block * j->outMax;
+	uchar *res = j->res + (size_t)block * j->hdr.blockSize;
+	size_t n;
+	Uint32 mode = GEN_BLOCK_STORED;
+
+	gen_block_residuals(&j->hdr, raw, len, res);
+	n = gen_block_pack(res, len, out, j->outMax);
+	if (!n || n >= sizeof(mode) + len) {
+		// incompressible; store the residuals as they are
+		memcpy(out, &mode, sizeof(mode));
+		memcpy(out + sizeof(mode), res, len);
+		n = sizeof(mode) + len;
+	}
+	j->outSizes[block] = n;
+}
+
+size_t gen_pack(const void *data, size_t size, int stride, int pitch,
+				void **packed) {
+	const size_t mark = gen_scratch_mark();
+	gen_codec_job_t j;
+	uchar *out, *p;
+	size_t total, rows;
+	Uint32 i, end;
+
+	*packed = NULL;
+	if (size < 1 || size > 0xFFFFFFFFu || stride < 1 || pitch < 0
+		|| (pitch && pitch < stride))
+		return 0;
+
+	memset(&j, 0, sizeof(j));
+	j.raw = data;
+	j.size = size;
+	j.hdr.stride = stride;
+	j.hdr.pitch = pitch;
+	// blocks hold whole rows, since their first rows are predicted from the
+	// left only
+	if (pitch) {
+		rows = GEN_CODEC_BLOCK / pitch;
+		j.hdr.blockSize = (rows > 0 ? rows : 1) * pitch;
+	} else
+		j.hdr.blockSize = GEN_CODEC_BLOCK;
+	j.hdr.numBlocks = (size + j.hdr.blockSize - 1) / j.hdr.blockSize;
+	// the worst case of a stored block, padded to keep the headers aligned
+	j.outMax = (sizeof(gen_block_header_t) + 4 + j.hdr.blockSize + 3) & ~3;
+	// the temporaries are set up here, as the jobs mustn't touch the arena
+	j.out = gen_scratch_alloc(j.outMax * j.hdr.numBlocks);
+	j.res = gen_scratch_alloc(size);
+	j.outSizes = gen_scratch_alloc(sizeof(*j.outSizes) * j.hdr.numBlocks);
+	if (!j.out || !j.res || !j.outSizes) {
+		gen_scratch_rewind(mark);
+		return 0;
+	}
+	ac_jobs_run(j.hdr.numBlocks, 1, gen_pack_block, &j, NULL);
+
+	total = sizeof(j.hdr) + sizeof(Uint32) * j.hdr.numBlocks;
+	for (i = 0; i < j.hdr.numBlocks; i++)
+		total += j.outSizes[i];
+	if (total >= size || !(out = malloc(total))) {
+		gen_scratch_rewind(mark);
+		return 0;
+	}
+
+	// header, block end offsets and the blocks themselves
+	memcpy(out, &j.hdr, sizeof(j.hdr));
+	p = out + sizeof(j.hdr) + sizeof(Uint32) * j.hdr.numBlocks;
+	for (i = 0, end = 0; i < j.hdr.numBlocks; i++) {
+		memcpy(p, j.out + (size_t)i * j.outMax, j.outSizes[i]);
+		p += j.outSizes[i];
+		end += j.outSizes[i];
+		memcpy(out + sizeof(j.hdr) + sizeof(Uint32) * i, &end, sizeof(end));
+	}
+	gen_scratch_rewind(mark);
+	*packed = out;
+	return total;
+}
+
+/// Unpacks a single block; the unpacking job callback.
+static void gen_unpack_block(void *ctx, int block) {
+	gen_codec_job_t *j = ctx;
+	const size_t len = gen_block_len(&j->hdr, j->size, block);
+	uchar *raw = j->out + (size_t)block * j->hdr.blockSize;
+	const Uint32 start = block > 0 ? j->ends[block - 1] : 0;
+	const Uint32 end = j->ends[block];
+
+	if (start > end || end > j->packedSize
+		|| !gen_block_unpack(j->blocks + start, end - start, raw, len)) {
+		SDL_AtomicSet(&j->failed, 1);
+		return;
+	}
+	gen_block_reconstruct(&j->hdr, raw, len);
+}
+
+bool gen_unpack(const void *packed, size_t packedSize, void *data,
+				size_t size) {
+	gen_codec_job_t j;
+	size_t tableSize;
+
+	if (packedSize < sizeof(j.hdr))
+		return false;
+	memset(&j, 0, sizeof(j));
+	memcpy(&j.hdr, packed, sizeof(j.hdr));
+	if (j.hdr.stride < 1 || j.hdr.blockSize < 1
+		|| (j.hdr.pitch && (j.hdr.pitch < j.hdr.stride
+			|| j.hdr.blockSize % j.hdr.pitch))
+		|| j.hdr.numBlocks != (size + j.hdr.blockSize - 1) / j.hdr.blockSize)
+		return false;
+	tableSize = sizeof(Uint32) * j.hdr.numBlocks;
+	if (packedSize < sizeof(j.hdr) + tableSize)
+		return false;
+
+	j.size = size;
+	j.out = data;
+	// the offsets are 4-byte aligned within the section, which is aligned
+	// itself
+	j.ends = (const Uint32 *)((const uchar *)packed + sizeof(j.hdr));
+	j.blocks = (const uchar *)packed + sizeof(j.hdr) + tableSize;
+	j.packedSize = packedSize - sizeof(j.hdr) - tableSize;
+	SDL_AtomicSet(&j.failed, 0);
+	// the blocks don't depend on each other, so decode them in parallel
+	ac_jobs_run(j.hdr.numBlocks, 1, gen_unpack_block, &j, NULL);
+	return !SDL_AtomicGet(&j.failed);
+}
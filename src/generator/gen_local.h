@@ -0,0 +1,322 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Local content generator header file
+
+#ifndef GEN_LOCAL_H
+#define GEN_LOCAL_H
+
+#include "../ac130.h"
+#include "../ac_jobs.h"
+
+/// \file gen_local.h
+/// \brief Private interfaces to all content generator modules.
+
+/// \addtogroup priv_gen Private content generator interface
+/// @{
+
+// make sure we don't use the libc rand() in the generator!
+#define rand()	assert(!"Are you kidding me?!")
+
+/// Number of heightmap rows handed out to a worker thread at once.
+#define GEN_BAND_ROWS		16
+/// Number of noise samples evaluated in a single batch by the row workers.
+#define GEN_NOISE_BATCH		64
+
+/// \brief Generator revision.
+/// Must be bumped whenever a change to the generator alters its output, so
+/// that stale world caches are discarded.
+#define GEN_REVISION		5
+
+/// Builds a cache section identifier out of 4 characters.
+#define GEN_FOURCC(a, b, c, d)	((Uint32)(a) | ((Uint32)(b) << 8)				\
+								| ((Uint32)(c) << 16) | ((Uint32)(d) << 24))
+/// \name Cache sections
+/// Sections hold raw copies of in-memory structures, so any change to the
+/// layout of those must be followed by a cache format version bump.
+/// @{
+#define GEN_SECTION_HEIGHTMAP	GEN_FOURCC('H', 'M', 'A', 'P')	///< heightmap
+#define GEN_SECTION_PROP_TEX	GEN_FOURCC('P', 'T', 'E', 'X')	///< prop texture
+#define GEN_SECTION_FX_TEX		GEN_FOURCC('F', 'X', 'T', 'X')	///< FX texture
+#define GEN_SECTION_TREES		GEN_FOURCC('T', 'R', 'E', 'E')	///< tree list
+#define GEN_SECTION_BLDGS		GEN_FOURCC('B', 'L', 'D', 'G')	///< building list
+#define GEN_SECTION_PROPTREE	GEN_FOURCC('P', 'T', 'R', 'E')	///< prop tree
+#define GEN_SECTION_OVERVIEW	GEN_FOURCC('O', 'V', 'R', 'V')	///< overview map
+#define GEN_SECTION_RANGES		GEN_FOURCC('H', 'R', 'N', 'G')	///< height ranges
+/// @}
+
+/// Number of cloud noise layers in the terrain.
+#define GEN_CLOUD_LAYERS	4
+
+/// \brief Binary logarithm of the terrain store chunk size.
+/// 2^7 = 128, which makes for 16 kB chunks.
+#define GEN_CHUNK_SHIFT		7
+/// Dimension of a terrain store chunk (both width and height).
+#define GEN_CHUNK_SIZE		(1 << GEN_CHUNK_SHIFT)
+/// \brief Binary logarithm of the overview map downsampling factor.
+/// Every overview texel is a copy of every 8th heightmap texel.
+#define GEN_OVERVIEW_SHIFT	3
+
+/// Cloud noise layer parameters.
+typedef struct {
+	size_t	xoff, yoff;
+	float	freq;
+} gen_cloud_layer_t;
+
+/// \brief Terrain generation parameters.
+/// Every heightmap texel is a function of these and its coordinates alone,
+/// which allows generating any part of the heightmap independently.
+typedef struct {
+	gen_cloud_layer_t	clouds[GEN_CLOUD_LAYERS];	///< cloud noise layers
+	int					xoff, yoff;	///< topography noise offsets
+	float				freq;		///< topography noise frequency
+} gen_terrain_params_t;
+
+/// \brief Generator stages, each with random numbers of its own.
+/// The values are part of the random number keys, so existing ones must not
+/// be changed without a \ref GEN_REVISION bump.
+typedef enum {
+	GEN_RNG_PROP_TEX,		///< prop texture, keyed by row
+	GEN_RNG_PROPMAP,		///< prop map walks, keyed by walk and prop type
+	GEN_RNG_PROPS,			///< prop placement, keyed by prop map square
+	GEN_RNG_PROP_PATTERNS	///< prop position patterns, keyed by pattern
+} gen_rng_stage_t;
+
+/// \brief Counter-based pseudorandom number generator state.
+/// Every number is a pure function of the world seed, the stage, the cell
+/// coordinates and the number of numbers drawn before it, so any cell may be
+/// generated on its own, on any thread, in any order.
+typedef struct {
+	Uint64	key;		///< hash of the seed, stage and cell coordinates
+	Uint64	counter;	///< number of numbers drawn so far
+} gen_rng_t;
+
+/// \brief True to draw all random numbers from the single sequential
+/// generator, which keeps the worlds of the existing seeds intact.
+/// \sa gen_set_legacy_rng
+extern bool gen_legacy_rng;
+
+/// \brief True to pack the cache sections that ask for it.
+/// \sa gen_set_cache_packing
+extern bool gen_cache_packing;
+
+// main generator module
+/// \brief Internal pseudorandom number generator.
+/// This is the legacy, sequential generator; use \ref gen_rng_next instead.
+int gen_rand(void);
+/// \brief Keys a counter-based random number generator.
+/// \param stage		generator stage the numbers are drawn for
+/// \param x		X coordinate of the cell (or any other index)
+/// \param y		Y coordinate of the cell (or any other index)
+void gen_rng_init(gen_rng_t *r, gen_rng_stage_t stage, int x, int y);
+/// \brief Draws the next number from a counter-based generator.
+/// In the legacy mode, the number is drawn from \ref gen_rand instead.
+/// \return			pseudorandom number in the [0..2^31 - 2] range
+int gen_rng_next(gen_rng_t *r);
+/// \brief Generates a span of heightmap texels of a single row.
+/// \param dst		array to write the n texels to
+/// \param x0		heightmap X coordinate of the first texel
+/// \param y		heightmap Y coordinate of the row
+/// \param n		number of texels to generate
+/// \param step		heightmap texels between consecutive samples
+void gen_terrain_span(const gen_terrain_params_t *p, uchar *dst,
+						int x0, int y, int n, int step);
+/// \brief Generates a block of heightmap texels on the worker thread pool.
+/// Rows are written one after another, with a pitch of width texels.
+/// \param step		heightmap texels between consecutive samples, in both
+///					directions
+/// \param tick		optional function to call once per finished row
+void gen_terrain_block(const gen_terrain_params_t *p, uchar *dst,
+						int x0, int y0, int width, int height, int step,
+						void (*tick)(void));
+
+// noise module
+/// \brief Improved Perlin noise generator.
+/// \return			noise value in the [-1..1] range
+float gen_perlin(float x, float y, float z);
+/// \brief Evaluates Perlin noise at 4 points at once using SSE2.
+/// The results are bit-exact with those of \ref gen_perlin.
+/// \param x		array of 4 X coordinates
+/// \param y		array of 4 Y coordinates
+/// \param z		array of 4 Z coordinates
+/// \param out		array to write the 4 noise values to
+void gen_perlin4(const float *x, const float *y, const float *z, float *out);
+/// \brief Evaluates Perlin noise at 8 points at once.
+/// Uses AVX2 if the compiler targets it, otherwise falls back to 2 calls to
+/// \ref gen_perlin4. The results are bit-exact with those of \ref gen_perlin.
+/// \param x		array of 8 X coordinates
+/// \param y		array of 8 Y coordinates
+/// \param z		array of 8 Z coordinates
+/// \param out		array to write the 8 noise values to
+void gen_perlin8(const float *x, const float *y, const float *z, float *out);
+/// \brief Evaluates Perlin noise at an arbitrary number of points.
+/// Uses the widest kernel available and the scalar one for the remainder.
+/// \param n		number of points in the arrays
+void gen_perlin_batch(const float *x, const float *y, const float *z,
+						float *out, size_t n);
+
+// cache module
+/// \brief Computes the CRC-32 (IEEE 802.3) of a block of memory.
+/// \param crc		CRC of the preceding data, 0 to start a new checksum
+/// \return			updated checksum
+Uint32 gen_crc32(Uint32 crc, const void *data, size_t size);
+/// \brief Maps the cache file for the given seed into memory.
+/// Files written with a different format version, heightmap size, seed or
+/// generator revision, as well as corrupted ones, are rejected. Opening the
+/// cache for the seed it is already open for does nothing.
+/// \return			true if a valid cache file has been mapped
+bool gen_cache_open(int seed);
+/// \brief Removes the temporary files a process has left behind.
+/// A process that gets terminated while writing the cache file of the given
+/// seed, or the asset cache file, leaves the temporary file it was writing
+/// into behind; nothing else ever removes it.
+/// \param pid		ID of the process
+void gen_cache_remove_temp(int seed, unsigned long pid);
+/// \brief Looks a section up in the currently mapped cache file.
+/// The returned memory is a private, copy-on-write mapping: it may be modified,
+/// but the changes never reach the file. It stays valid until
+/// \ref gen_cache_close is called.
+/// \param id		section identifier (see \ref GEN_FOURCC)
+/// \param size		expected size of the section data
+/// \return			pointer to the section data, NULL if the section is missing
+///					or its size doesn't match
+void *gen_cache_get(Uint32 id, size_t size);
+/// \brief Returns the size of a section in the currently mapped cache file.
+/// \return			size of the section data, 0 if the section is missing
+size_t gen_cache_size(Uint32 id);
+/// \brief Unmaps the current cache file and drops the queued sections.
+void gen_cache_close(void);
+/// \brief Queues a section to be written by \ref gen_cache_flush.
+/// The data is copied, so the caller may release it right away.
+void gen_cache_put(Uint32 id, const void *data, size_t size);
+/// \brief Queues a section to be packed and written by \ref gen_cache_flush.
+/// Falls back to \ref gen_cache_put if packing is disabled or doesn't make the
+/// section any smaller. Packed sections are unpacked by \ref gen_cache_get on
+/// first use, into memory that stays valid until \ref gen_cache_close.
+/// \param stride	see \ref gen_pack
+/// \param pitch		see \ref gen_pack
+void gen_cache_put_packed(Uint32 id, const void *data, size_t size,
+							int stride, int pitch);
+/// \brief Tells whether a section of the currently mapped cache file is packed.
+/// Packed sections can only be unpacked in their entirety.
+bool gen_cache_packed(Uint32 id);
+/// \brief Writes the queued sections into the cache file.
+/// The sections of the currently mapped file that haven't been replaced are
+/// carried over. Does nothing if no sections have been queued.
+/// \return			true on success
+bool gen_cache_flush(void);
+/// \brief Looks a section up in the asset cache.
+/// The asset cache holds the content that doesn't depend on the world (e.g. the
+/// FX texture) and is only rejected on a format version or generator revision
+/// change. It is mapped on first use.
+/// \sa gen_cache_get
+void *gen_asset_get(Uint32 id, size_t size);
+/// \brief Returns the size of a section in the asset cache.
+/// \sa gen_cache_size
+size_t gen_asset_size(Uint32 id);
+/// \brief Queues a section to be written into the asset cache.
+/// \sa gen_cache_put
+void gen_asset_put(Uint32 id, const void *data, size_t size);
+/// \brief Writes the queued sections into the asset cache.
+/// \return			true on success
+bool gen_asset_flush(void);
+/// \brief Unmaps the asset cache and drops the queued sections.
+void gen_asset_close(void);
+
+// cache codec module
+/// \brief Packs a block of memory losslessly.
+/// Every byte is predicted from its already coded neighbours (the median of the
+/// left, upper and upper left ones for 2D data, the left one otherwise), and
+/// the prediction residuals are entropy coded with rANS, in independent blocks
+/// of whole rows that are coded on the worker thread pool.
+/// \param stride	bytes between an element and its left neighbour, e.g. 1
+///					for a heightmap or the structure size for an array of
+///					structures
+/// \param pitch		bytes between rows of 2D data, 0 for 1D data
+/// \param packed	pointer to where to store the malloc()'ed packed data
+/// \return			size of the packed data, 0 if it wouldn't be any smaller
+///					than the input (in which case nothing is allocated)
+size_t gen_pack(const void *data, size_t size, int stride, int pitch,
+				void **packed);
+/// \brief Unpacks data packed by \ref gen_pack, on the worker thread pool.
+/// \param size		size of the unpacked data
+/// \return			false if the packed data is malformed
+bool gen_unpack(const void *packed, size_t packedSize, void *data,
+				size_t size);
+
+// terrain store module
+/// \brief Tells whether the heightmap needs to be streamed.
+/// \return			true if the entire heightmap exceeds the memory budget
+bool gen_store_wanted(void);
+/// \brief Returns the terrain memory budget in bytes.
+/// \sa gen_set_terrain_budget
+size_t gen_store_get_budget(void);
+/// \brief Starts streaming the heightmap.
+/// \param p		terrain parameters to generate the chunks with
+/// \param source	entire heightmap to copy the chunks from instead of
+///					generating them (e.g. mapped from the cache); may be NULL
+void gen_store_init(const gen_terrain_params_t *p, const uchar *source);
+/// \brief Returns the overview map of the streamed heightmap.
+/// It's up to the caller to fill it after \ref gen_store_init.
+uchar *gen_store_overview(void);
+/// \brief Stops streaming and frees all the chunks; does nothing if the
+/// heightmap isn't streamed.
+void gen_store_shutdown(void);
+
+// height range module
+/// \brief Allocates the height range pyramid for the current heightmap size.
+/// The contents are undefined until filled by \ref gen_range_rows and
+/// \ref gen_range_finish or loaded by \ref gen_range_load.
+void gen_range_init(void);
+/// \brief Frees the height range pyramid.
+void gen_range_free(void);
+/// \brief Computes the ranges of the base cells covered by a block of rows.
+/// Only the cells whose texels all lie within the block are computed, so
+/// consecutive blocks need to overlap by 1 row. Runs on the worker thread pool.
+/// \param rows		heightmap rows, HEIGHTMAP_SIZE texels each
+/// \param y0		heightmap Y coordinate of the first row
+/// \param numRows	number of rows in the block
+void gen_range_rows(const uchar *rows, int y0, int numRows);
+/// \brief Builds the coarser levels of the pyramid out of the base cells and
+/// queues the pyramid for writing into the cache.
+void gen_range_finish(void);
+/// \brief Recomputes the ranges of the cells covering a changed region of the
+/// heightmap, on all levels of the pyramid.
+/// \param heightmap	the entire heightmap
+/// \param x0, y0		upper left corner of the region, inclusive
+/// \param x1, y1		lower right corner of the region, inclusive
+void gen_range_update(const uchar *heightmap, int x0, int y0, int x1,
+	int y1);
+/// \brief Allocates the height range pyramid and loads it from the cache.
+/// \return			true if the pyramid has been found in the cache
+bool gen_range_load(void);
+
+// scratch memory module
+/// \brief Allocates temporary memory from the scratch arena.
+/// The arena is a stack of large blocks that the allocations are carved out of
+/// one after another, so allocating is almost free and there is nothing to
+/// free individually; all of it is released by \ref gen_scratch_reset at the
+/// end of every generator stage that uses it. Must only be called from the
+/// thread running the stage, never from the jobs it runs on the thread pool.
+/// \return			16 byte aligned memory, NULL if out of memory
+void *gen_scratch_alloc(size_t size);
+/// \brief Allocates zeroed temporary memory from the scratch arena.
+/// \sa gen_scratch_alloc
+void *gen_scratch_calloc(size_t count, size_t size);
+/// \brief Returns the current position of the scratch arena.
+/// Passing it to \ref gen_scratch_rewind later on releases everything
+/// allocated in between, e.g. the buffers of a step that aren't needed by the
+/// rest of the stage.
+size_t gen_scratch_mark(void);
+/// \brief Releases everything allocated from the scratch arena since the
+/// given position (see \ref gen_scratch_mark).
+void gen_scratch_rewind(size_t mark);
+/// \brief Releases everything allocated from the scratch arena.
+void gen_scratch_reset(void);
+/// \brief Restarts counting the peak size of the scratch arena.
+/// \sa gen_scratch_peak
+void gen_scratch_reset_peak(void);
+
+/// @}
+
+#endif // GEN_LOCAL_H
@@ -0,0 +1,1841 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Procedural content generation module
+
+#include "gen_local.h"
+#include <stdio.h>
+#include <string.h>
+
+int				gen_heightmap_size = DEFAULT_HEIGHTMAP_SIZE;
+uchar			*gen_heightmap = NULL;
+ac_prop_t		*gen_proptree = NULL;
+ac_tree_t		*gen_trees = NULL;
+ac_bldg_t		*gen_bldgs = NULL;
+ac_bldg_coll_t	gen_bldg_coll;
+
+/// Number of nodes in the prop tree.
+static int		gen_numprops = 0;
+
+/// True if the heightmap points into a mapped cache file.
+static bool		gen_heightmap_mapped = false;
+
+/// Seed for the internal pseudorandom number generator.
+static uint		gen_seed = 0;
+/// Seed of the world the counter-based generators are keyed with.
+static uint		gen_world_seed = 0;
+
+bool			gen_legacy_rng = false;
+
+/// Internal pseudorandom number generator.
+int gen_rand(void) {
+	gen_seed = (16807LL * (gen_seed + 1)) % 2147483647;
+	return gen_seed - 1;
+}
+
+/// SplitMix64 finalizer; scatters the bits of the key components.
+static inline Uint64 gen_mix64(Uint64 x) {
+	x ^= x >> 30;
+	x *= 0xBF58476D1CE4E5B9ULL;
+	x ^= x >> 27;
+	x *= 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+void gen_rng_init(gen_rng_t *r, gen_rng_stage_t stage, int x, int y) {
+	Uint64 key = gen_mix64(((Uint64)gen_world_seed << 32) | (Uint32)stage);
+	key = gen_mix64(key ^ (((Uint64)(Uint32)y << 32) | (Uint32)x));
+	// the squares generator wants an odd key
+	r->key = key | 1;
+	r->counter = 0;
+}
+
+int gen_rng_next(gen_rng_t *r) {
+	Uint64 x, y, z;
+
+	if (gen_legacy_rng)
+		return gen_rand();
+
+	// Widynski's "squares" counter-based generator: 4 rounds of squaring the
+	// counter times the key, swapping the halves in between
+	y = x = r->counter++ * r->key;
+	z = y + r->key;
+	x = x * x + y;
+	x = (x >> 32) | (x << 32);
+	x = x * x + z;
+	x = (x >> 32) | (x << 32);
+	x = x * x + y;
+	x = (x >> 32) | (x << 32);
+	// same range as gen_rand()
+	return (int)((x * x + z) >> 33);
+}
+
+void gen_set_legacy_rng(bool legacy) {
+	// the cache files of both modes are not interchangeable
+	gen_cache_close();
+	gen_legacy_rng = legacy;
+}
+
+void gen_terrain_span(const gen_terrain_params_t *p, uchar *dst,
+						int x0, int y, int n, int step) {
+	const gen_cloud_layer_t *l;
+	float nx[GEN_NOISE_BATCH], ny[GEN_NOISE_BATCH], nz[GEN_NOISE_BATCH];
+	float noise[GEN_CLOUD_LAYERS + 1][GEN_NOISE_BATCH];
+	int i, j, k, b, x, pix;
+	size_t cx, cy = y;
+	char cloud;
+
+	for (b = 0; b < n; b += k) {
+		k = n - b < GEN_NOISE_BATCH ? n - b : GEN_NOISE_BATCH;
+		// cloud noise layers
+		for (j = 0; j < GEN_CLOUD_LAYERS; j++) {
+			l = &p->clouds[j];
+			for (i = 0; i < k; i++) {
+				cx = x0 + (b + i) * step;
+				nx[i] = (float)(cx + l->xoff) * l->freq;
+				ny[i] = (float)(cy + l->yoff) * l->freq;
+				nz[i] = sqrtf((cx + l->xoff) * (cy + l->yoff)) * l->freq;
+			}
+			gen_perlin_batch(nx, ny, nz, noise[j], k);
+		}
+		// topography noise
+		for (i = 0; i < k; i++) {
+			x = x0 + (b + i) * step;
+			nx[i] = (float)(x + p->xoff) * p->freq;
+			ny[i] = (float)(y + p->yoff) * p->freq;
+			nz[i] = sqrtf((x + p->xoff) * (y + p->yoff)) * p->freq;
+		}
+		gen_perlin_batch(nx, ny, nz, noise[GEN_CLOUD_LAYERS], k);
+
+		for (i = 0; i < k; i++) {
+			// combine the cloud layers, each subsequent one with half the
+			// weight of the previous
+			cloud = (char)(127.f * noise[0][i]);
+			for (j = 1; j < GEN_CLOUD_LAYERS; j++) {
+				pix = (int)cloud
+					+ (int)((char)(127.f * noise[j][i])) / (2 << (j - 1));
+				if (pix < -128)
+					pix = -128;
+				else if (pix > 127)
+					pix = 127;
+				cloud = (char)pix;
+			}
+			pix = 127;
+#if 1
+			// pass 1 - rough topography
+			pix = (uchar)(pix + (char)(127.f * noise[GEN_CLOUD_LAYERS][i]));
+#endif
+#if 1
+			// pass 2 - cloud detail
+			pix += (int)(cloud / 2);
+			if (pix < 0)
+				pix = 0;
+			else if (pix > 255)
+				pix = 255;
+#endif
+			dst[b + i] = pix;
+		}
+	}
+}
+
+/// Block of heightmap texels to generate.
+typedef struct {
+	const gen_terrain_params_t	*params;
+	uchar						*dst;
+	int							pitch;	///< distance between rows in dst
+	int							x0, y0;	///< heightmap coords of the 1st texel
+	int							width;	///< number of texels per row
+	int							step;	///< heightmap texels between samples
+} gen_terrain_block_t;
+
+static void gen_terrain_block_row(void *ctx, int row) {
+	const gen_terrain_block_t *b = ctx;
+	gen_terrain_span(b->params, b->dst + row * b->pitch, b->x0,
+		b->y0 + row * b->step, b->width, b->step);
+}
+
+void gen_terrain_block(const gen_terrain_params_t *p, uchar *dst,
+						int x0, int y0, int width, int height, int step,
+						void (*tick)(void)) {
+	gen_terrain_block_t b;
+
+	b.params = p;
+	b.dst = dst;
+	b.pitch = width;
+	b.x0 = x0;
+	b.y0 = y0;
+	b.width = width;
+	b.step = step;
+	// every row only depends on its own texels, so fill them in parallel
+	ac_jobs_run(height, GEN_BAND_ROWS, gen_terrain_block_row, &b, tick);
+}
+
+bool gen_set_heightmap_size(int size) {
+	if (gen_heightmap != NULL || gen_store_overview() != NULL
+		|| size < MIN_HEIGHTMAP_SIZE
+		|| size > MAX_HEIGHTMAP_SIZE || (size & (size - 1)) != 0)
+		return false;
+	// the cache file name depends on the size, so close the old one
+	gen_cache_close();
+	gen_heightmap_size = size;
+	return true;
+}
+
+void gen_open_world(int seed) {
+	// the legacy generator used to start every world from the same state, as
+	// there was only ever one world per process
+	gen_seed = 0;
+	gen_world_seed = seed;
+	gen_scratch_reset_peak();
+	gen_cache_open(seed);
+}
+
+void gen_save_world(void) {
+	gen_cache_flush();
+	// the assets are only ever needed while loading
+	gen_asset_flush();
+	gen_asset_close();
+}
+
+/// \brief Maximum number of heightmap regions changed by \ref gen_crater and
+/// not yet picked up by \ref gen_next_dirty_rect.
+/// Any more get merged into the last one.
+#define GEN_MAX_DIRTY_RECTS	16
+
+static int		gen_dirty[GEN_MAX_DIRTY_RECTS][4];
+static int		gen_numdirty = 0;
+
+// the props of a streamed heightmap are laid out before its strips are
+// generated, so that their heights can be sampled off the strips; the functions
+// are defined along with the rest of the prop code
+static void gen_plan_props(void);
+static void gen_sample_strip(const uchar *rows, int y0, int numRows);
+static void gen_end_props(void);
+
+/// Releases the heightmap, be it allocated, mapped from the cache or streamed.
+static void gen_release_heightmap(void) {
+	gen_numdirty = 0;
+	gen_end_props();
+	gen_store_shutdown();
+	gen_range_free();
+	if (!gen_heightmap_mapped)
+		free(gen_heightmap);
+	gen_heightmap = NULL;
+	gen_heightmap_mapped = false;
+}
+
+void gen_free_terrain(void) {
+	gen_release_heightmap();
+	gen_cache_close();
+}
+
+/// Number of height range cell rows covered by a strip of the streamed
+/// heightmap generated at once by \ref gen_terrain_strips.
+#define GEN_STRIP_CELLS		16
+
+/// \brief Builds the overview map and the height range pyramid of a streamed
+/// heightmap.
+/// Goes over the heightmap in strips, so that it's never resident in its
+/// entirety. The heights of the props planned by \ref gen_plan_props are
+/// sampled off the strips on the way.
+/// \param source		entire heightmap to read the strips from instead of
+///					generating them (e.g. mapped from the cache); may be NULL
+static void gen_terrain_strips(const gen_terrain_params_t *p,
+								const uchar *source, uchar *overview) {
+	const int stripRows = GEN_STRIP_CELLS << HEIGHT_RANGE_SHIFT;
+	const int ovSize = HEIGHTMAP_SIZE >> GEN_OVERVIEW_SHIFT;
+	uchar *strip = NULL;
+	const uchar *rows;
+	int x, y, y0, numRows;
+
+	if (!source)
+		strip = gen_scratch_alloc((size_t)(stripRows + 1) * HEIGHTMAP_SIZE);
+	for (y0 = 0; y0 < HEIGHTMAP_SIZE; y0 += stripRows) {
+		// the strips overlap by a row, which the last cells of the previous
+		// one extend to
+		numRows = y0 + stripRows < HEIGHTMAP_SIZE
+			? stripRows + 1 : HEIGHTMAP_SIZE - y0;
+		if (source)
+			rows = source + (size_t)y0 * HEIGHTMAP_SIZE;
+		else {
+			gen_terrain_block(p, strip, 0, y0, HEIGHTMAP_SIZE, numRows, 1,
+				NULL);
+			rows = strip;
+		}
+		gen_range_rows(rows, y0, numRows);
+		gen_sample_strip(rows, y0, numRows);
+		// every overview texel is a copy of a heightmap one
+		for (y = y0; y < y0 + stripRows && y < HEIGHTMAP_SIZE;
+			y += 1 << GEN_OVERVIEW_SHIFT) {
+			for (x = 0; x < ovSize; x++)
+				overview[(y >> GEN_OVERVIEW_SHIFT) * ovSize + x] =
+					rows[(size_t)(y - y0) * HEIGHTMAP_SIZE
+						+ (x << GEN_OVERVIEW_SHIFT)];
+		}
+		for (y = y0; y < y0 + stripRows && y < HEIGHTMAP_SIZE; y++)
+			g_loading_tick();
+	}
+}
+
+void gen_terrain(int seed) {
+	gen_terrain_params_t params;
+	const uchar *cached = NULL, *ovCached;
+	uchar *overview;
+	bool rangesCached;
+	float freq;
+	const size_t size = HEIGHTMAP_SIZE * HEIGHTMAP_SIZE;
+	const int ovSize = HEIGHTMAP_SIZE >> GEN_OVERVIEW_SHIFT;
+	const bool stream = gen_store_wanted();
+	size_t mark;
+	int i;
+
+	gen_release_heightmap();
+
+	gen_world_seed = seed;
+
+	// the handful of terrain and cloud parameters are drawn up front, so both
+	// generators take them from the legacy sequence, which keeps the
+	// landscapes of all the existing seeds intact
+
+	// HACK: this xor is a litle manipulation to keep a pre-bugfix landscape for
+	// a particular random seed (the seed used to be initialized after the
+	// frequency) while maintaining the randomness of the algorithm
+	gen_seed = seed ^ 0xDEADBEEF;
+	params.freq = 0.005 + 0.000001 * (float)((gen_rand() % 6000) - 3000);
+	gen_seed = seed;
+	params.xoff = gen_rand() % (HEIGHTMAP_SIZE);
+	params.yoff = gen_rand() % (HEIGHTMAP_SIZE);
+	// the cloud layer offsets are drawn in the same order as they have always
+	// been drawn, so that the landscapes stay the same
+	freq = 0.015 + 0.000001 * (float)((gen_rand() % 10000) - 5000);
+	for (i = 0; i < GEN_CLOUD_LAYERS; i++, freq *= 2.0) {
+		params.clouds[i].freq = freq;
+		params.clouds[i].xoff = gen_rand() % (HEIGHTMAP_SIZE * 2);
+		params.clouds[i].yoff = gen_rand() % (HEIGHTMAP_SIZE * 2);
+	}
+
+	// all the random numbers have been drawn by now, so the props that follow
+	// come out the same no matter if the terrain is generated or cached
+	// a packed heightmap would have to be unpacked in its entirety, which is
+	// exactly what streaming is meant to avoid
+	if (gen_cache_open(seed)
+		&& !(stream && gen_cache_packed(GEN_SECTION_HEIGHTMAP)))
+		cached = gen_cache_get(GEN_SECTION_HEIGHTMAP, size);
+	rangesCached = gen_range_load();
+	if (cached && !stream) {
+		gen_heightmap = (uchar *)cached;
+		gen_heightmap_mapped = true;
+		if (!rangesCached) {
+			gen_range_rows(gen_heightmap, 0, HEIGHTMAP_SIZE);
+			gen_range_finish();
+		}
+		return;
+	}
+
+	// make sure the vectorized noise matches the reference implementation
+	assert(gen_perlin_check());
+
+	if (stream) {
+		// the heightmap doesn't fit in the budget, stream it in chunks and
+		// only keep a low resolution overview of it around
+		gen_store_init(&params, cached);
+		overview = gen_store_overview();
+		if (rangesCached && (ovCached = gen_cache_get(GEN_SECTION_OVERVIEW,
+			ovSize * ovSize)) != NULL) {
+			memcpy(overview, ovCached, ovSize * ovSize);
+			return;
+		}
+		// placing the props later on would need the whole heightmap to be
+		// generated once more, chunk by chunk
+		if (!cached)
+			gen_plan_props();
+		mark = gen_scratch_mark();
+		gen_terrain_strips(&params, cached, overview);
+		gen_scratch_rewind(mark);
+		gen_range_finish();
+		gen_cache_put_packed(GEN_SECTION_OVERVIEW, overview, ovSize * ovSize,
+			1, ovSize);
+		return;
+	}
+
+	gen_heightmap = malloc(size);
+	gen_terrain_block(&params, gen_heightmap, 0, 0,
+		HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, 1, g_loading_tick);
+	gen_range_rows(gen_heightmap, 0, HEIGHTMAP_SIZE);
+	gen_range_finish();
+
+	// since we've successfully generated a height map, dump it into a cache
+	gen_cache_put_packed(GEN_SECTION_HEIGHTMAP, gen_heightmap, size,
+		1, HEIGHTMAP_SIZE);
+}
+
+/// \brief Reads a heightmap texel by its index in the heightmap array.
+/// Indices past the end of the array are clamped to the last texel.
+static uchar gen_height_at(size_t i) {
+	const size_t size = (size_t)HEIGHTMAP_SIZE * HEIGHTMAP_SIZE;
+
+	if (i >= size)
+		i = size - 1;
+	return gen_height(i % HEIGHTMAP_SIZE, i / HEIGHTMAP_SIZE);
+}
+
+/// \brief Heightmap strip being generated by \ref gen_terrain_strips.
+/// The props sample their heights off it instead of the terrain store.
+static const uchar	*gen_strip_rows = NULL;
+static int			gen_strip_y0, gen_strip_numrows;
+
+/// Reads a heightmap texel, off the current strip if there is one.
+static inline uchar gen_sample_texel(int x, int y) {
+	if (!gen_strip_rows)
+		return gen_height(x, y);
+	assert(y >= gen_strip_y0 && y < gen_strip_y0 + gen_strip_numrows);
+	return gen_strip_rows[(size_t)(y - gen_strip_y0) * HEIGHTMAP_SIZE + x];
+}
+
+static float gen_sample_height(float x, float y) {
+#if 1
+	// bilinear filtering
+	float xi, yi, xfrac, yfrac;
+	float fR1, fR2;
+	int x0, y0, x1, y1;
+	size_t i;
+
+	xfrac = modff(x, &xi);
+	yfrac = modff(y, &yi);
+	x0 = xi;
+	y0 = yi;
+	if (gen_legacy_rng) {
+		// older versions indexed the heightmap array directly, so the texels
+		// past the right edge were those at the start of the next row; keep
+		// reading them, so that the props along that edge stay where they
+		// were (those past the bottom edge were outside the array and can't be
+		// reproduced)
+		i = (size_t)y0 * HEIGHTMAP_SIZE + x0;
+		fR1 = (1.f - xfrac) * gen_height_at(i)
+			+ xfrac * gen_height_at(i + 1);
+		fR2 = (1.f - xfrac) * gen_height_at(i + HEIGHTMAP_SIZE)
+			+ xfrac * gen_height_at(i + HEIGHTMAP_SIZE + 1);
+		return ((1.f - yfrac) * fR1 + yfrac * fR2) * HEIGHT_SCALE;
+	}
+	// don't read past the edges of the map
+	x1 = x0 + 1 < HEIGHTMAP_SIZE ? x0 + 1 : x0;
+	y1 = y0 + 1 < HEIGHTMAP_SIZE ? y0 + 1 : y0;
+
+	// bilinear filtering
+	fR1 = (1.f - xfrac) * gen_sample_texel(x0, y0)
+		+ xfrac * gen_sample_texel(x1, y0);
+	fR2 = (1.f - xfrac) * gen_sample_texel(x0, y1)
+		+ xfrac * gen_sample_texel(x1, y1);
+	return ((1.f - yfrac) * fR1 + yfrac * fR2) * HEIGHT_SCALE;
+#else
+	// nearest filtering
+	return gen_height((int)roundf(x), (int)roundf(y)) * HEIGHT_SCALE;
+#endif
+}
+
+void gen_props(uchar *texture, ac_vertex_t *verts, uchar *indices) {
+	int i, l, base, vofs, iofs;
+	const float invScale = 1.f / (PROP_TEXTURE_SIZE - 1);
+	const size_t texSize = PROP_TEXTURE_SIZE * PROP_TEXTURE_SIZE;
+	const uchar *cached;
+	gen_rng_t rng;
+	float rpi;
+
+	// generate vertices and indices
+
+	// trees
+
+	// vertex #0 - tip of the tree
+	verts[0].pos = ac_vec_set(0, 1, 0, 0);
+	verts[0].st[0] = 1;
+	verts[0].st[1] = 0;
+
+	vofs = 1;
+	iofs = 0;
+	for (l = 0; l < 3; l++) {
+		base = TREE_BASE - l * 2;
+		rpi = (M_PI * 2.f) / (float)base;	// radians per iteration
+		indices[iofs++] = 0;	// start with the tip of the tree
+		// tree base vertices and indices
+		for (i = 0; i < base; i++) {
+			verts[vofs].pos = ac_vec_set(cosf(i * rpi), -0.1, sinf(i * rpi), 0);
+			verts[vofs].st[0] = 0;
+			verts[vofs].st[1] = 0;
+			indices[iofs++] = vofs++;
+		}
+		indices[iofs++] = vofs - base;	// first base vertex - full circle
+	}
+
+	g_loading_tick();
+
+	// buildings
+
+	// flat roof
+	l = vofs;
+	for (i = 0; i < 8; i++, vofs++) {
+		verts[vofs].pos = ac_vec_set(
+			((i + 1) / 2) % 2 == 0 ? -0.5 : 0.5,
+			i < 4 ? -1 : 1,
+			(i / 2) % 2 == 0 ? -0.5 : 0.5,
+			0);
+		verts[vofs].st[0] = i % 2;
+		verts[vofs].st[1] = i < 4 ? 1 : (1.f / (float)(PROP_TEXTURE_SIZE - 1));
+		if (i < 4) {
+			indices[iofs++] = l + i + 4;
+			indices[iofs++] = l + i;
+		}
+	}
+	// close the wall
+	indices[iofs++] = l + 4;
+	indices[iofs++] = l;
+	// degenerate triangle
+	indices[iofs] = indices[iofs - 1];
+	iofs++;
+	indices[iofs++] = l + 4;
+	// rooftop
+	indices[iofs++] = l + 4;
+	indices[iofs++] = l + 5;
+	indices[iofs++] = l + 7;
+	indices[iofs++] = l + 6;
+
+	// slanted roof
+	l = vofs;
+	// building base
+	for (i = 0; i < 8; i++, vofs++) {
+		verts[vofs].pos = ac_vec_set(
+			((i + 1) / 2) % 2 == 0 ? -0.5 : 0.5,
+			i < 4 ? -1 : 1,
+			(i / 2) % 2 == 0 ? -0.5 : 0.5,
+			0);
+		verts[vofs].st[0] = i % 2;
+		verts[vofs].st[1] = i < 4 ? 1 : (2.f / (float)(PROP_TEXTURE_SIZE - 1));
+		if (i < 4) {
+			indices[iofs++] = l + i + 4;
+			indices[iofs++] = l + i;
+		}
+	}
+	// close the wall
+	indices[iofs++] = l + 4;
+	indices[iofs++] = l;
+	// roof verts
+	verts[vofs].pos = ac_vec_set(0, 1.4, -0.5, 0);
+	verts[vofs].st[0] = 0.5;
+	verts[vofs++].st[1] = (1.f / (float)(PROP_TEXTURE_SIZE - 1));
+	verts[vofs].pos = ac_vec_set(0, 1.4, 0.5, 0);
+	verts[vofs].st[0] = 0.5;
+	verts[vofs++].st[1] = (1.f / (float)(PROP_TEXTURE_SIZE - 1));
+	// degenerate triangle
+	indices[iofs] = indices[iofs - 1];
+	iofs++;
+	indices[iofs++] = l + 4;
+	// north roof filler
+	indices[iofs++] = l + 4;
+	indices[iofs++] = l + 5;
+	indices[iofs++] = l + 8;
+	// degenerate triangle
+	indices[iofs++] = l + 8;
+	indices[iofs++] = l + 6;
+	// south roof filler
+	indices[iofs++] = l + 6;
+	indices[iofs++] = l + 9;
+	indices[iofs++] = l + 7;
+	// degenerate triangle
+	indices[iofs++] = l + 7;
+	indices[iofs++] = l + 6;
+	// rooftop
+	indices[iofs++] = l + 7;
+	indices[iofs++] = l + 4;
+	indices[iofs++] = l + 9;
+	indices[iofs++] = l + 8;
+	indices[iofs++] = l + 6;
+	indices[iofs++] = l + 5;
+
+	// texture
+	if ((cached = gen_cache_get(GEN_SECTION_PROP_TEX, texSize)) != NULL) {
+		memcpy(texture, cached, texSize);
+		return;
+	}
+
+	// tree strip: exponential gradient from gray to black
+	for (i = 0; i < PROP_TEXTURE_SIZE; i++)
+		texture[i] = 127 * expf(-2.f * i * invScale);
+	// building roof - 2 pixels wide
+	for (i = 0; i < PROP_TEXTURE_SIZE; i++)
+		texture[PROP_TEXTURE_SIZE + i] = 20;
+	for (i = 0; i < PROP_TEXTURE_SIZE; i++)
+		texture[PROP_TEXTURE_SIZE * 2 + i] = 40;
+	// building wall
+	for (l = 3; l < PROP_TEXTURE_SIZE; l++) {
+		gen_rng_init(&rng, GEN_RNG_PROP_TEX, 0, l);
+		for (i = 0; i < PROP_TEXTURE_SIZE; i++)
+			texture[PROP_TEXTURE_SIZE * l + i] = 96 + gen_rng_next(&rng) % 32;
+	}
+	// window
+	for (l = 0; l < 9; l++) {
+		for (i = 0; i < 11; i++) {
+			if (i == 5 || l == 4)
+				continue;
+			texture[(l + PROP_TEXTURE_SIZE / 2 - PROP_TEXTURE_SIZE / 3) * PROP_TEXTURE_SIZE
+				+ i + PROP_TEXTURE_SIZE / 2 - 5] = 255;
+		}
+	}
+
+	gen_cache_put(GEN_SECTION_PROP_TEX, texture, texSize);
+
+	g_loading_tick();
+}
+
+static inline float gen_smoothstep(float t) {
+	return t * t * (3 - 2 * t);
+}
+
+/// Generates a single row of the FX texture.
+static void gen_fx_row(void *ctx, int i) {
+	uchar *texture = (uchar *)ctx + i * FX_TEXTURE_SIZE * 2;
+	int j;
+	float d, x, f, perlin;
+	float nx[FX_TEXTURE_SIZE], ny[FX_TEXTURE_SIZE], nz[FX_TEXTURE_SIZE];
+	float noise[FX_TEXTURE_SIZE];
+	const float r = (FX_TEXTURE_SIZE - 1) * 0.5;
+	const float invr = 1.f / r;
+	const float invr2 = invr * invr;
+	const float y = (float)i - r;
+
+	// sample the noise for the entire row at once
+	for (j = 0; j < FX_TEXTURE_SIZE; j++) {
+		x = (float)j - r;
+		nx[j] = x * invr * 4;
+		ny[j] = y * invr * 4;
+		// this won't give us an exact sphere, but it's close enough
+		nz[j] = -sinf(acosf(x * y * invr2)) * invr * 4;
+	}
+	gen_perlin_batch(nx, ny, nz, noise, FX_TEXTURE_SIZE);
+	for (j = 0; j < FX_TEXTURE_SIZE; j++) {
+		x = (float)j - r;
+		d = sqrtf(x * x + y * y);
+		perlin = noise[j];
+		texture[j * 2 + 0] = 225 + perlin * 30;
+		if (d <= r - 80.f)
+			texture[j * 2 + 1] = 255;
+		else if (d <= r) {
+			f = (r - d) / 80.f;
+			perlin = (perlin + 1.f) * 0.5;
+			texture[j * 2 + 1] =
+				gen_smoothstep(f) * 255 * (f + perlin * (1 - f));
+		} else
+			texture[j * 2 + 1] = 0;
+	}
+}
+
+void gen_fx(uchar *texture, ac_vertex_t *verts, uchar *indices) {
+	int i;
+	const size_t texSize = 2 * FX_TEXTURE_SIZE * FX_TEXTURE_SIZE;
+	const uchar *cached;
+
+	// geometry
+	for (i = 0; i < 4; i++) {
+		verts[i].pos = ac_vec_set(
+			i % 2 == 0 ? -0.5 : 0.5,
+			i < 2 ? 0.5 : -0.5,
+			0,
+			0);
+		verts[i].st[0] = i % 2 == 0 ? 0 : 1;
+		verts[i].st[1] = i < 2 ? 0 : 1;
+		indices[i] = i;
+	}
+
+	// texture; it doesn't depend on the seed, so it's shared by all the worlds
+	if ((cached = gen_asset_get(GEN_SECTION_FX_TEX, texSize)) != NULL) {
+		memcpy(texture, cached, texSize);
+		return;
+	}
+
+	assert(gen_perlin_check());
+
+	// every row only depends on its own texels, so fill them in parallel
+	ac_jobs_run(FX_TEXTURE_SIZE, GEN_BAND_ROWS, gen_fx_row, texture,
+		g_loading_tick);
+
+	gen_asset_put(GEN_SECTION_FX_TEX, texture, texSize);
+}
+
+/// Maximum number of levels of the prop map occupancy pyramid.
+#define GEN_MAX_PROP_LEVELS	16
+
+static uchar	*gen_propmap;
+/// \brief Prop map occupancy pyramid.
+/// Level 0 is the prop map itself, every other one is half the size of the
+/// previous one and marks its 2x2 blocks that hold any props; every non-zero
+/// entry becomes a prop tree node.
+static uchar	*gen_proplevels[GEN_MAX_PROP_LEVELS];
+static int		gen_numproplevels;
+
+/// Maximum length of a single prop map random walk.
+#define GEN_MAX_WALK		10
+
+/// \brief Prop map occupancy bitset, 1 bit per square.
+/// Mirrors the non-zero entries of the prop map in an 8 times smaller array,
+/// which is what the random walks check over and over again.
+static Uint32	*gen_propbits;
+/// \brief Prop map squares to start the random walks from.
+/// Squares are only removed from the list when they are picked and found to
+/// be occupied, so some of the listed ones may be occupied already.
+static int		*gen_freeprops;
+static int		gen_numfreeprops;
+
+/// Random walk stack frame.
+typedef struct {
+	int		x, y;
+	int		dir;	///< next direction to try
+} gen_walk_frame_t;
+
+static inline bool gen_propmap_taken(int k) {
+	return (gen_propbits[k >> 5] >> (k & 31)) & 1;
+}
+
+static inline void gen_propmap_take(int k, uchar value) {
+	gen_propbits[k >> 5] |= 1u << (k & 31);
+	gen_propmap[k] = value;
+}
+
+/// \brief Picks the square to start a random walk from.
+/// The legacy generator simply picks a random square, which may well be
+/// occupied already; otherwise, one of the free squares is picked.
+/// \return			false if there are no free squares left
+static bool gen_propmap_seed(gen_rng_t *rng, int *x, int *y) {
+	int i, k;
+
+	if (gen_legacy_rng) {
+		// the coordinates are drawn in the order the legacy generator has
+		// always drawn them
+		*y = gen_rng_next(rng) % PROPMAP_SIZE;
+		*x = gen_rng_next(rng) % PROPMAP_SIZE;
+		return true;
+	}
+
+	while (gen_numfreeprops > 0) {
+		i = gen_rng_next(rng) % gen_numfreeprops;
+		k = gen_freeprops[i];
+		if (!gen_propmap_taken(k)) {
+			*x = k % PROPMAP_SIZE;
+			*y = k / PROPMAP_SIZE;
+			return true;
+		}
+		// occupied in the meantime, drop it from the list
+		gen_freeprops[i] = gen_freeprops[--gen_numfreeprops];
+	}
+	return false;
+}
+
+/// \brief Fills the prop map with a random walk.
+/// Starting at the given square, every filled square continues the walk in
+/// each of the 8 directions with a 66% chance, depth first, until the walk
+/// has filled trace squares or the counter runs out.
+/// \param counter	maximum number of squares to fill in total
+/// \param trace		maximum number of squares to fill in this walk
+/// \return			number of squares filled
+static int gen_propmap_populate(gen_rng_t *rng, int x, int y, int counter,
+									int trace, uchar value) {
+	static const int dirs[8][2] = {
+		{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}
+	};
+	gen_walk_frame_t stack[GEN_MAX_WALK], *f;
+	int k, depth, filled = 0;
+
+	assert(trace <= GEN_MAX_WALK);
+	k = y * PROPMAP_SIZE + x;
+	if (!trace || !counter || gen_propmap_taken(k))
+		return 0;
+	gen_propmap_take(k, value);
+	filled++;
+	trace--;
+	counter--;
+	if (!trace || !counter)
+		return filled;
+
+	// every frame stands for a filled square, and there are at most trace of
+	// them, so the stack can't overflow
+	stack[0].x = x;
+	stack[0].y = y;
+	stack[0].dir = 0;
+	depth = 1;
+	while (depth > 0) {
+		f = &stack[depth - 1];
+		if (f->dir >= 8 || !counter) {
+			depth--;
+			continue;
+		}
+		// try to continue in the next direction with a 66% chance; note that
+		// this also draws the numbers once the trace is exhausted, which the
+		// legacy generator has always done
+		if (gen_rng_next(rng) % 100 <= 33) {
+			f->dir++;
+			continue;
+		}
+		x = f->x + dirs[f->dir][0];
+		y = f->y + dirs[f->dir][1];
+		f->dir++;
+		if (x < 0 || x >= PROPMAP_SIZE || y < 0 || y >= PROPMAP_SIZE
+			|| !trace)
+			continue;
+		k = y * PROPMAP_SIZE + x;
+		if (gen_propmap_taken(k))
+			continue;
+		gen_propmap_take(k, value);
+		filled++;
+		trace--;
+		counter--;
+		if (!trace || !counter)
+			continue;
+		f = &stack[depth++];
+		f->x = x;
+		f->y = y;
+		f->dir = 0;
+	}
+	return filled;
+}
+
+static void gen_create_propmap(void) {
+	const int numFields = PROPMAP_SIZE * PROPMAP_SIZE;
+	int treeFields = TREE_COVERAGE * numFields;
+	int bldgFields = BLDG_COVERAGE * numFields;
+	const size_t mark = gen_scratch_mark();
+	gen_rng_t rng;
+	int i, x, y, trace, walk;
+
+	// the walk state is the largest of the temporaries, and not needed past
+	// the walks, so it's released right away
+	gen_propbits = gen_scratch_calloc((numFields + 31) / 32,
+		sizeof(*gen_propbits));
+	gen_freeprops = gen_scratch_alloc(sizeof(*gen_freeprops) * numFields);
+	for (i = 0; i < numFields; i++)
+		gen_freeprops[i] = i;
+	gen_numfreeprops = numFields;
+
+	// every random walk gets a generator of its own
+	for (walk = 0; treeFields > 0; walk++) {
+		gen_rng_init(&rng, GEN_RNG_PROPMAP, walk, 1);
+		trace = 1 + gen_rng_next(&rng) % 10;
+		if (!gen_propmap_seed(&rng, &x, &y))
+			break;
+		treeFields -= gen_propmap_populate(&rng, x, y, treeFields, trace, 1);
+	}
+
+	g_loading_tick();
+
+	for (walk = 0; bldgFields > 0; walk++) {
+		gen_rng_init(&rng, GEN_RNG_PROPMAP, walk, 2);
+		trace = 1 + gen_rng_next(&rng) % 4;
+		if (!gen_propmap_seed(&rng, &x, &y))
+			break;
+		bldgFields -= gen_propmap_populate(&rng, x, y, bldgFields, trace, 2);
+	}
+
+	g_loading_tick();
+
+	gen_scratch_rewind(mark);
+	gen_freeprops = NULL;
+	gen_propbits = NULL;
+}
+
+/// Builds the occupancy pyramid on top of the prop map.
+/// \return			number of prop tree nodes
+static int gen_create_proplevels(void) {
+	int i, x, y, size, fine, numNodes = 0;
+	const uchar *f;
+	uchar *c;
+
+	gen_proplevels[0] = gen_propmap;
+	for (i = 0; i < PROPMAP_SIZE * PROPMAP_SIZE; i++)
+		numNodes += gen_propmap[i] != 0;
+
+	for (gen_numproplevels = 1, size = PROPMAP_SIZE >> 1; size > 0;
+		gen_numproplevels++, size >>= 1) {
+		assert(gen_numproplevels < GEN_MAX_PROP_LEVELS);
+		f = gen_proplevels[gen_numproplevels - 1];
+		fine = size << 1;
+		c = gen_proplevels[gen_numproplevels] = gen_scratch_alloc(size * size);
+		for (y = 0; y < size; y++) {
+			for (x = 0; x < size; x++, c++) {
+				*c = f[(y * 2) * fine + x * 2] || f[(y * 2) * fine + x * 2 + 1]
+					|| f[(y * 2 + 1) * fine + x * 2]
+					|| f[(y * 2 + 1) * fine + x * 2 + 1];
+				numNodes += *c;
+			}
+		}
+	}
+	return numNodes;
+}
+
+/// Maximum dimension of the Poisson disc background grid, in cells.
+#define GEN_POISSON_GRID		16
+/// Number of candidates tried around an active point before it's retired.
+#define GEN_POISSON_TRIES		16
+/// Number of Poisson disc patterns the prop map squares pick their trees from.
+#define GEN_TREE_PATTERNS		64
+
+/// Prop tree leaf awaiting its props.
+typedef struct {
+	int		index;		///< node index
+	int		x, y;		///< prop map coordinates
+	int		slot;		///< index of the first prop slot reserved for the leaf
+} gen_leaf_t;
+
+/// Leaf placement job context.
+typedef struct {
+	gen_leaf_t	*leaves;
+	ac_tree_t	*trees;
+	ac_bldg_t	*bldgs;
+} gen_place_ctx_t;
+
+/// Poisson disc pattern of prop positions within a prop map square.
+typedef struct {
+	float	pts[TREES_PER_FIELD][2];
+	int		count;
+} gen_pattern_t;
+
+static gen_pattern_t	gen_tree_patterns[GEN_TREE_PATTERNS];
+
+static gen_leaf_t	*gen_leaves;
+static int			gen_numleaves;
+static int			gen_numtreeleaves, gen_numbldgleaves;
+
+/// True if the prop tree has been laid out by \ref gen_plan_props already.
+static bool			gen_props_planned = false;
+/// \brief Prop heights sampled off the strips of a streamed heightmap, by prop
+/// slot; NULL if the props are to sample the heightmap themselves.
+static float		*gen_tree_heights = NULL, *gen_bldg_heights = NULL;
+
+/// Draws a number in the [0..1) range.
+static inline float gen_rng_float(gen_rng_t *r) {
+	return (float)(gen_rng_next(r) & 0xFFFFFF) * (1.f / 16777216.f);
+}
+
+/// \brief Scatters points over a prop map square using Poisson disc sampling.
+/// Uses Bridson's algorithm with a background grid of cells small enough to
+/// hold at most one point each, so that checking a candidate only takes a
+/// look at the cells around it. The candidates are tried at evenly stepped
+/// angles, just over the spacing away from an active point, which packs the
+/// points tighter and takes fewer tries than random ones. The points are kept
+/// half the spacing away from the edges of the square, so they're well spaced
+/// across the squares as well, even though every square is scattered
+/// independently.
+/// \param spacing	minimum distance between points
+/// \param max		maximum number of points
+/// \param pts		array to write the points to, relative to the square
+/// \return			number of points
+static int gen_poisson_disc(gen_rng_t *rng, float spacing, int max,
+							float (*pts)[2]) {
+	const float extent = (float)(1 << PROPMAP_SHIFT) - spacing;
+	const float cell = spacing * (float)M_SQRT1_2;
+	const float dist = spacing * 1.0001f;
+	const float stepCos = cosf(2.f * M_PI / GEN_POISSON_TRIES);
+	const float stepSin = sinf(2.f * M_PI / GEN_POISSON_TRIES);
+	const float minDist2 = spacing * spacing;
+	const int side = (int)ceilf(extent / cell);
+	int grid[GEN_POISSON_GRID * GEN_POISSON_GRID];
+	int active[PROPS_PER_FIELD];
+	int i, j, k, n, p, numActive, cx, cy, x0, x1, y0, y1;
+	float px, py, dx, dy, c, s, t;
+	bool ok;
+
+	assert(side <= GEN_POISSON_GRID && max <= PROPS_PER_FIELD);
+	for (i = 0; i < side * side; i++)
+		grid[i] = -1;
+
+	pts[0][0] = gen_rng_float(rng) * extent;
+	pts[0][1] = gen_rng_float(rng) * extent;
+	grid[(int)(pts[0][1] / cell) * side + (int)(pts[0][0] / cell)] = 0;
+	active[0] = 0;
+	numActive = 1;
+	n = 1;
+	while (numActive > 0 && n < max) {
+		i = gen_rng_next(rng) % numActive;
+		// start at a random angle and go round
+		t = gen_rng_float(rng) * 2.f * M_PI;
+		c = cosf(t);
+		s = sinf(t);
+		for (k = 0; k < GEN_POISSON_TRIES; k++) {
+			if (k > 0) {
+				t = c * stepCos - s * stepSin;
+				s = s * stepCos + c * stepSin;
+				c = t;
+			}
+			px = pts[active[i]][0] + c * dist;
+			py = pts[active[i]][1] + s * dist;
+			if (px < 0.f || px >= extent || py < 0.f || py >= extent)
+				continue;
+			cx = (int)(px / cell);
+			cy = (int)(py / cell);
+			x0 = cx > 2 ? cx - 2 : 0;
+			y0 = cy > 2 ? cy - 2 : 0;
+			x1 = cx + 2 < side ? cx + 2 : side - 1;
+			y1 = cy + 2 < side ? cy + 2 : side - 1;
+			ok = true;
+			for (j = y0; ok && j <= y1; j++) {
+				for (cx = x0; cx <= x1; cx++) {
+					if ((p = grid[j * side + cx]) < 0)
+						continue;
+					dx = pts[p][0] - px;
+					dy = pts[p][1] - py;
+					if (dx * dx + dy * dy < minDist2) {
+						ok = false;
+						break;
+					}
+				}
+			}
+			if (ok)
+				break;
+		}
+		if (k == GEN_POISSON_TRIES) {
+			// nothing fits around this one anymore
+			active[i] = active[--numActive];
+			continue;
+		}
+		pts[n][0] = px;
+		pts[n][1] = py;
+		grid[(int)(py / cell) * side + (int)(px / cell)] = n;
+		active[numActive++] = n++;
+	}
+
+	for (i = 0; i < n; i++) {
+		pts[i][0] += spacing * 0.5f;
+		pts[i][1] += spacing * 0.5f;
+	}
+	return n;
+}
+
+/// Scatters a single tree pattern.
+static void gen_make_tree_pattern(void *ctx, int item) {
+	gen_rng_t rng;
+
+	(void)ctx;	// shut up compiler
+
+	gen_rng_init(&rng, GEN_RNG_PROP_PATTERNS, item, 0);
+	gen_tree_patterns[item].count = gen_poisson_disc(&rng, TREE_SPACING,
+		TREES_PER_FIELD, gen_tree_patterns[item].pts);
+}
+
+/// \brief Picks the tree positions of a prop map square.
+/// Sampling a Poisson disc anew for every square would take way longer than
+/// placing the trees, so the squares pick one of the precomputed patterns
+/// instead, mirrored and transposed at random. Since the patterns keep away
+/// from the edges of the square, they stay well spaced in any orientation.
+/// \return			number of trees
+static int gen_tree_positions(gen_rng_t *rng, float (*pts)[2]) {
+	const gen_pattern_t *p =
+		&gen_tree_patterns[gen_rng_next(rng) % GEN_TREE_PATTERNS];
+	const int sym = gen_rng_next(rng) % 8;
+	const float edge = (float)(1 << PROPMAP_SHIFT);
+	float x, y;
+	int i;
+
+	for (i = 0; i < p->count; i++) {
+		x = (sym & 1) ? edge - p->pts[i][0] : p->pts[i][0];
+		y = (sym & 2) ? edge - p->pts[i][1] : p->pts[i][1];
+		pts[i][0] = (sym & 4) ? y : x;
+		pts[i][1] = (sym & 4) ? x : y;
+	}
+	return p->count;
+}
+
+/// \brief Finishes the position of a prop of a prop map square.
+/// The legacy generator scatters the props uniformly, drawing the position of
+/// each right before its other properties; the Poisson disc has already
+/// been sampled otherwise.
+/// \param pt		position relative to the square, overwritten in the legacy
+///					mode; turned into heightmap coordinates
+static void gen_prop_position(gen_rng_t *rng, int x, int y, float *pt) {
+	if (gen_legacy_rng) {
+		pt[0] = (x << PROPMAP_SHIFT) + 0.01 * (gen_rng_next(rng)
+			% ((1 << PROPMAP_SHIFT) * 100));
+		pt[1] = (y << PROPMAP_SHIFT) + 0.01 * (gen_rng_next(rng)
+			% ((1 << PROPMAP_SHIFT) * 100));
+		return;
+	}
+	pt[0] += x << PROPMAP_SHIFT;
+	pt[1] += y << PROPMAP_SHIFT;
+}
+
+/// Computes the vertical extents of a leaf out of its props.
+static void gen_leaf_bounds(ac_prop_t *node, const ac_tree_t *trees,
+							const ac_bldg_t *bldgs) {
+	float h, min = FLT_MAX, max = -FLT_MAX;
+	int i;
+
+	switch (node->type) {
+		case PROP_TREES:
+			for (i = 0; i < node->count; i++) {
+				h = trees[i].pos.f[1];
+				// the tree model spans from -0.1 to 1 along the Y axis
+				if (h - 0.1 * trees[i].Yscale < min)
+					min = h - 0.1 * trees[i].Yscale;
+				if (h + trees[i].Yscale > max)
+					max = h + trees[i].Yscale;
+			}
+			break;
+		case PROP_BLDGS:
+			for (i = 0; i < node->count; i++) {
+				h = bldgs[i].pos.f[1];
+				// the building model spans from -1 to 1.4 (the slanted roof's
+				// ridge) along the Y axis
+				if (h - bldgs[i].Yscale < min)
+					min = h - bldgs[i].Yscale;
+				if (h + 1.4 * bldgs[i].Yscale > max)
+					max = h + 1.4 * bldgs[i].Yscale;
+			}
+			break;
+		default:
+			break;
+	}
+	node->bounds[0] = min;
+	node->bounds[1] = max;
+}
+
+/// \brief Places the props of a prop map square.
+/// \param heights	heights of the props sampled in advance; may be NULL
+static void gen_place_props(ac_prop_t *node, ac_tree_t *trees,
+					ac_bldg_t *bldgs, int x, int y, const float *heights) {
+	float pts[PROPS_PER_FIELD][2];
+	int i, quad;
+	float h;
+	gen_rng_t rng;
+
+	// keyed by the prop map square, so it doesn't matter in which order the
+	// squares are visited
+	gen_rng_init(&rng, GEN_RNG_PROPS, x, y);
+	switch (node->type) {
+		case PROP_TREES:
+			node->count = gen_legacy_rng ? TREES_PER_FIELD
+				: gen_tree_positions(&rng, pts);
+			for (i = 0; i < node->count; i++) {
+				gen_prop_position(&rng, x, y, pts[i]);
+				h = heights ? heights[i]
+					: gen_sample_height(pts[i][0], pts[i][1]);
+				trees[i].pos = ac_vec_set(
+					pts[i][0] - HEIGHTMAP_SIZE * 0.5,
+					h,
+					pts[i][1] - HEIGHTMAP_SIZE * 0.5,
+					1.f);
+				trees[i].ang =
+					(gen_rng_next(&rng) % 360) / 180.f * M_PI;
+				trees[i].XZscale =
+					1.0 + 0.001 * (gen_rng_next(&rng) % 1201);
+				trees[i].Yscale =
+					2.4 + 0.001 * (gen_rng_next(&rng) % 3201);
+			}
+			break;
+		case PROP_BLDGS:
+			node->count = gen_legacy_rng ? BLDGS_PER_FIELD
+				: gen_poisson_disc(&rng, BLDG_SPACING, BLDGS_PER_FIELD, pts);
+			for (i = 0; i < node->count; i++) {
+				gen_prop_position(&rng, x, y, pts[i]);
+				h = heights ? heights[i]
+					: gen_sample_height(pts[i][0], pts[i][1]);
+				bldgs[i].pos = ac_vec_set(
+					pts[i][0] - HEIGHTMAP_SIZE * 0.5,
+					h,
+					pts[i][1] - HEIGHTMAP_SIZE * 0.5,
+					1.f);
+				// draw the quadrant and the deviation in a fixed order
+				quad = gen_rng_next(&rng) % 4;
+				bldgs[i].ang =
+					(quad * 90 - 10 + gen_rng_next(&rng) % 21)
+						/ 180.f * M_PI;
+				bldgs[i].Xscale =
+					5 + 0.001 * (gen_rng_next(&rng) % 2001);
+				bldgs[i].Zscale =
+					7 + 0.001 * (gen_rng_next(&rng) % 3001);
+				bldgs[i].Yscale =
+					2.8 + 0.001 * (gen_rng_next(&rng) % 3001);
+				bldgs[i].slantedRoof =
+					gen_rng_next(&rng) % 100 >= 33;
+			}
+			break;
+		default:
+			break;
+	}
+	gen_leaf_bounds(node, trees, bldgs);
+}
+
+/// Number of batches the prop tree leaves are placed in, a loading tick each.
+#define GEN_PLACE_BATCHES	64
+
+/// Places the props of a single leaf into the slots reserved for it.
+static void gen_place_leaf(void *ctx, int item) {
+	const gen_place_ctx_t *c = ctx;
+	const gen_leaf_t *l = &c->leaves[item];
+	const float *heights = NULL;
+
+	if (gen_tree_heights)
+		heights = (gen_proptree[l->index].type == PROP_TREES
+			? gen_tree_heights : gen_bldg_heights) + l->slot;
+	gen_place_props(&gen_proptree[l->index], c->trees + l->slot,
+		c->bldgs + l->slot, l->x, l->y, heights);
+}
+
+/// Places the props of a batch of consecutive leaves.
+static void gen_place_batch(void *ctx, int item) {
+	const int last = gen_numleaves * (item + 1) / GEN_PLACE_BATCHES;
+	int i;
+
+	for (i = gen_numleaves * item / GEN_PLACE_BATCHES; i < last; i++)
+		gen_place_leaf(ctx, i);
+}
+
+/// \brief Lays out the given prop tree node and the subtree below it.
+/// The node's children are allocated next to each other, right at the end of
+/// the nodes used so far, and then laid out one after another. Leaves only
+/// get their type and are queued up in \ref gen_leaves for the props to be
+/// placed in later.
+/// \param next		index of the first unused node in the array
+static void gen_build_proptree(int index, int *next, int level, int x, int y) {
+	ac_prop_t *node = &gen_proptree[index];
+	const uchar *fine;
+	gen_leaf_t *l;
+	int q, c, fineSize;
+
+	node->children = 0;
+	node->count = 0;
+	if (level == 0) {
+		l = &gen_leaves[gen_numleaves++];
+		l->index = index;
+		l->x = x;
+		l->y = y;
+		// reserve room for as many props as the leaf may possibly get
+		if (gen_propmap[y * PROPMAP_SIZE + x] == 1) {
+			node->type = PROP_TREES;
+			l->slot = gen_numtreeleaves++ * TREES_PER_FIELD;
+		} else {
+			node->type = PROP_BLDGS;
+			l->slot = gen_numbldgleaves++ * BLDGS_PER_FIELD;
+		}
+		return;
+	}
+
+	fine = gen_proplevels[level - 1];
+	fineSize = PROPMAP_SIZE >> (level - 1);
+	node->type = PROP_BRANCH;
+	node->first = *next;
+	for (q = 0; q < 4; q++) {
+		if (fine[(y * 2 + (q >> 1)) * fineSize + x * 2 + (q & 1)]) {
+			node->children |= 1 << q;
+			(*next)++;
+		}
+	}
+
+	for (q = 0, c = node->first; q < 4; q++) {
+		if (!(node->children & (1 << q)))
+			continue;
+		gen_build_proptree(c++, next, level - 1,
+			x * 2 + (q & 1), y * 2 + (q >> 1));
+	}
+}
+
+/// \brief Places the props of all the prop tree leaves.
+/// The leaves are filled in parallel, in batches, each in the slots reserved
+/// for it, then the lists are compacted and the bounds of the branches are
+/// computed bottom up.
+static void gen_fill_proptree(int *numTrees, ac_tree_t *trees,
+								int *numBldgs, ac_bldg_t *bldgs) {
+	gen_place_ctx_t ctx;
+	ac_prop_t *node;
+	int i, q, c;
+
+	ctx.leaves = gen_leaves;
+	ctx.trees = trees;
+	ctx.bldgs = bldgs;
+	// the legacy generator draws its numbers in sequence, and a streamed
+	// heightmap may only be accessed from one thread
+	if (gen_legacy_rng || (!gen_heightmap && !gen_tree_heights)) {
+		for (i = 0; i < GEN_PLACE_BATCHES; i++) {
+			gen_place_batch(&ctx, i);
+			g_loading_tick();
+		}
+	} else
+		ac_jobs_run(GEN_PLACE_BATCHES, 1, gen_place_batch, &ctx,
+			g_loading_tick);
+
+	// no leaf gets more props than it has slots, so moving them down in order
+	// never overwrites the ones yet to be moved
+	*numTrees = 0;
+	*numBldgs = 0;
+	for (i = 0; i < gen_numleaves; i++) {
+		node = &gen_proptree[gen_leaves[i].index];
+		if (node->type == PROP_TREES) {
+			memmove(trees + *numTrees, trees + gen_leaves[i].slot,
+				sizeof(*trees) * node->count);
+			node->first = *numTrees;
+			*numTrees += node->count;
+		} else {
+			memmove(bldgs + *numBldgs, bldgs + gen_leaves[i].slot,
+				sizeof(*bldgs) * node->count);
+			node->first = *numBldgs;
+			*numBldgs += node->count;
+		}
+	}
+
+	// children always follow their parents
+	for (i = gen_numprops - 1; i >= 0; i--) {
+		node = &gen_proptree[i];
+		if (node->type != PROP_BRANCH)
+			continue;
+		node->bounds[0] = FLT_MAX;
+		node->bounds[1] = -FLT_MAX;
+		for (q = 0, c = node->first; q < 4; q++) {
+			if (!(node->children & (1 << q)))
+				continue;
+			if (gen_proptree[c].bounds[0] < node->bounds[0])
+				node->bounds[0] = gen_proptree[c].bounds[0];
+			if (gen_proptree[c].bounds[1] > node->bounds[1])
+				node->bounds[1] = gen_proptree[c].bounds[1];
+			c++;
+		}
+	}
+}
+
+void gen_prop_bounds(const ac_prop_t *n, int x, int y, int size,
+					ac_vec4_t bounds[2]) {
+	bounds[0] = ac_vec_set(
+		(x << PROPMAP_SHIFT) - HEIGHTMAP_SIZE / 2,
+		n->bounds[0],
+		(y << PROPMAP_SHIFT) - HEIGHTMAP_SIZE / 2,
+		0);
+	bounds[1] = ac_vec_set(
+		((x + size) << PROPMAP_SHIFT) - HEIGHTMAP_SIZE / 2,
+		n->bounds[1],
+		((y + size) << PROPMAP_SHIFT) - HEIGHTMAP_SIZE / 2,
+		0);
+}
+
+void gen_prop_child_bounds(const ac_prop_t *n, int x, int y, int size,
+					ac_box4_t *bounds) {
+	const ac_prop_t *c = gen_proptree + n->first;
+	float f[6][4];
+	int q, i;
+
+	assert(n->type == PROP_BRANCH);
+	size >>= 1;
+	for (q = 0; q < 4; q++) {
+		if (!(n->children & (1 << q))) {
+			for (i = 0; i < 3; i++) {
+				f[i][q] = FLT_MAX;
+				f[i + 3][q] = -FLT_MAX;
+			}
+			continue;
+		}
+		// the same corners as gen_prop_bounds gives
+		f[0][q] = ((x + (q & 1) * size) << PROPMAP_SHIFT) - HEIGHTMAP_SIZE / 2;
+		f[1][q] = c->bounds[0];
+		f[2][q] = ((y + (q >> 1) * size) << PROPMAP_SHIFT) - HEIGHTMAP_SIZE / 2;
+		f[3][q] = ((x + (q & 1) * size + size) << PROPMAP_SHIFT)
+			- HEIGHTMAP_SIZE / 2;
+		f[4][q] = c->bounds[1];
+		f[5][q] = ((y + (q >> 1) * size + size) << PROPMAP_SHIFT)
+			- HEIGHTMAP_SIZE / 2;
+		c++;
+	}
+	for (i = 0; i < 3; i++) {
+		bounds->mins[i] = ac_vec_set(f[i][0], f[i][1], f[i][2], f[i][3]);
+		bounds->maxs[i] = ac_vec_set(f[i + 3][0], f[i + 3][1], f[i + 3][2],
+			f[i + 3][3]);
+	}
+}
+
+/// Returns the number of bits set in the lowest 4 bits of the mask.
+static inline int gen_count_children(int mask) {
+	return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1)
+		+ ((mask >> 3) & 1);
+}
+
+/// Attempts to load the prop lists and the prop tree from the world cache.
+static bool gen_load_proplists(int *numTrees, ac_tree_t *trees,
+								int *numBldgs, ac_bldg_t *bldgs) {
+	const size_t treeSize = gen_cache_size(GEN_SECTION_TREES);
+	const size_t bldgSize = gen_cache_size(GEN_SECTION_BLDGS);
+	const size_t nodeSize = gen_cache_size(GEN_SECTION_PROPTREE);
+	const ac_prop_t *nodes, *n;
+	const ac_tree_t *cachedTrees;
+	const ac_bldg_t *cachedBldgs;
+	int i, numNodes, nt, nb;
+
+	if (treeSize % sizeof(*trees) || bldgSize % sizeof(*bldgs)
+		|| nodeSize % sizeof(*nodes))
+		return false;
+	nt = treeSize / sizeof(*trees);
+	nb = bldgSize / sizeof(*bldgs);
+	numNodes = nodeSize / sizeof(*nodes);
+	if (nt > MAX_NUM_TREES || nb > MAX_NUM_BLDGS || numNodes < 1)
+		return false;
+	cachedTrees = gen_cache_get(GEN_SECTION_TREES, treeSize);
+	cachedBldgs = gen_cache_get(GEN_SECTION_BLDGS, bldgSize);
+	nodes = gen_cache_get(GEN_SECTION_PROPTREE, nodeSize);
+	if (!cachedTrees || !cachedBldgs || !nodes)
+		return false;
+
+	// make sure the nodes only reference valid data; children always follow
+	// their parents, so there can be no cycles
+	for (i = 0, n = nodes; i < numNodes; i++, n++) {
+		switch (n->type) {
+			case PROP_BRANCH:
+				if (n->children == 0 || n->children > 0xF || n->count
+					|| n->first <= i
+					|| n->first + gen_count_children(n->children) > numNodes)
+					return false;
+				break;
+			case PROP_TREES:
+				if (n->children || n->first < 0 || n->count > TREES_PER_FIELD
+					|| n->first + n->count > nt)
+					return false;
+				break;
+			case PROP_BLDGS:
+				if (n->children || n->first < 0 || n->count > BLDGS_PER_FIELD
+					|| n->first + n->count > nb)
+					return false;
+				break;
+			default:
+				return false;
+		}
+	}
+
+	memcpy(trees, cachedTrees, treeSize);
+	memcpy(bldgs, cachedBldgs, bldgSize);
+	*numTrees = nt;
+	*numBldgs = nb;
+	gen_proptree = malloc(nodeSize);
+	memcpy(gen_proptree, nodes, nodeSize);
+	gen_numprops = numNodes;
+	return true;
+}
+
+/// Queues the prop lists and the prop tree for storage in the world cache.
+static void gen_save_proplists(int numTrees, const ac_tree_t *trees,
+								int numBldgs, const ac_bldg_t *bldgs) {
+	if (!gen_proptree)
+		return;
+	// the nodes hold no pointers, so they can be stored as they are; every
+	// field is predicted from the same field of the previous element
+	gen_cache_put_packed(GEN_SECTION_TREES, trees,
+		sizeof(*trees) * numTrees, sizeof(*trees), 0);
+	gen_cache_put_packed(GEN_SECTION_BLDGS, bldgs,
+		sizeof(*bldgs) * numBldgs, sizeof(*bldgs), 0);
+	gen_cache_put_packed(GEN_SECTION_PROPTREE, gen_proptree,
+		sizeof(*gen_proptree) * gen_numprops, sizeof(*gen_proptree), 0);
+}
+
+/// \brief Computes the range of building grid cells a building overlaps.
+/// \param r		array to store the first and last cell X and Y in
+static void gen_bldg_cells(int i, int r[4]) {
+	const ac_bldg_coll_t *t = &gen_bldg_coll;
+	const float half = HEIGHTMAP_SIZE / 2;
+	// horizontal extents of the rotated box, with a little slack for the
+	// rounding errors of the traces
+	const float ex = fabsf(t->c[i]) * t->hx[i] + fabsf(t->s[i]) * t->hz[i]
+		+ 0.01f;
+	const float ez = fabsf(t->s[i]) * t->hx[i] + fabsf(t->c[i]) * t->hz[i]
+		+ 0.01f;
+	int j;
+
+	r[0] = (int)floorf(t->x[i] - ex + half) >> t->cellShift;
+	r[1] = (int)floorf(t->z[i] - ez + half) >> t->cellShift;
+	r[2] = (int)floorf(t->x[i] + ex + half) >> t->cellShift;
+	r[3] = (int)floorf(t->z[i] + ez + half) >> t->cellShift;
+	for (j = 0; j < 4; j++)
+		r[j] = r[j] < 0 ? 0
+			: (r[j] >= t->cellSide ? t->cellSide - 1 : r[j]);
+}
+
+/// \brief Bins the buildings into the collision grid.
+/// A counting pass sizes the cells, so that they can all share a single array.
+static void gen_build_bldg_grid(int numBldgs) {
+	ac_bldg_coll_t *t = &gen_bldg_coll;
+	const int numCells = t->cellSide * t->cellSide;
+	int i, x, y, k, r[4];
+	float top;
+
+	t->cellStart = calloc(numCells + 1, sizeof(*t->cellStart));
+	t->cellTop = malloc(sizeof(*t->cellTop) * numCells);
+	for (i = 0; i < numCells; i++)
+		t->cellTop[i] = -FLT_MAX;
+	t->top = -FLT_MAX;
+	for (i = 0; i < numBldgs; i++) {
+		gen_bldg_cells(i, r);
+		for (y = r[1]; y <= r[3]; y++) {
+			for (x = r[0]; x <= r[2]; x++)
+				t->cellStart[y * t->cellSide + x]++;
+		}
+	}
+	// turn the counts into the ends of the cells
+	for (i = 1; i < numCells; i++)
+		t->cellStart[i] += t->cellStart[i - 1];
+	t->cellStart[numCells] = t->cellStart[numCells - 1];
+	t->cellBldgs = malloc(sizeof(*t->cellBldgs)
+		* (t->cellStart[numCells] > 0 ? t->cellStart[numCells] : 1));
+	// fill the cells from their ends, so that the ends become the starts and
+	// the buildings stay in order
+	for (i = numBldgs - 1; i >= 0; i--) {
+		gen_bldg_cells(i, r);
+		top = t->y[i] + t->hy[i];
+		if (t->top < top)
+			t->top = top;
+		for (y = r[1]; y <= r[3]; y++) {
+			for (x = r[0]; x <= r[2]; x++) {
+				k = y * t->cellSide + x;
+				t->cellBldgs[--t->cellStart[k]] = i;
+				if (t->cellTop[k] < top)
+					t->cellTop[k] = top;
+			}
+		}
+	}
+}
+
+/// \brief Builds the building collision table.
+/// The buildings never turn, so the trigonometry is only ever done here.
+static void gen_build_bldg_coll(int numBldgs) {
+	const size_t n = numBldgs > 0 ? numBldgs : 1;
+	float *p;
+	int i;
+
+	p = malloc(sizeof(*p) * n * 8);
+	gen_bldg_coll.x = p;
+	gen_bldg_coll.y = p + n;
+	gen_bldg_coll.z = p + n * 2;
+	gen_bldg_coll.c = p + n * 3;
+	gen_bldg_coll.s = p + n * 4;
+	gen_bldg_coll.hx = p + n * 5;
+	gen_bldg_coll.hy = p + n * 6;
+	gen_bldg_coll.hz = p + n * 7;
+	for (i = 0; i < numBldgs; i++) {
+		gen_bldg_coll.x[i] = gen_bldgs[i].pos.f[0];
+		gen_bldg_coll.z[i] = gen_bldgs[i].pos.f[2];
+		gen_bldg_coll.c[i] = cosf(gen_bldgs[i].ang);
+		gen_bldg_coll.s[i] = sinf(gen_bldgs[i].ang);
+		gen_bldg_coll.hx[i] = 0.5 * gen_bldgs[i].Xscale;
+		// the building model spans from -1 to 1 along the Y axis, or to 1.4
+		// with a slanted roof, so the box is centred above the origin then
+		gen_bldg_coll.hy[i] = (gen_bldgs[i].slantedRoof ? 1.2 : 1.f)
+			* gen_bldgs[i].Yscale;
+		gen_bldg_coll.y[i] = gen_bldgs[i].pos.f[1] - gen_bldgs[i].Yscale
+			+ gen_bldg_coll.hy[i];
+		gen_bldg_coll.hz[i] = 0.5 * gen_bldgs[i].Zscale;
+	}
+	// a cell per prop map square
+	gen_bldg_coll.cellShift = PROPMAP_SHIFT;
+	gen_bldg_coll.cellSide = PROPMAP_SIZE;
+	gen_build_bldg_grid(numBldgs);
+}
+
+/// \brief Generates the prop map and lays out the prop tree on top of it.
+/// Leaves only get their type and prop slots reserved in \ref gen_leaves. All
+/// the temporaries come from the scratch arena and stay there until
+/// \ref gen_end_props.
+static void gen_layout_props(void) {
+	int next = 1;
+
+	gen_propmap = gen_scratch_calloc(PROPMAP_SIZE * PROPMAP_SIZE,
+		sizeof(*gen_propmap));
+
+	// generate a propmap to roughly place clusters of objects
+	gen_create_propmap();
+
+	// use the propmap to place the actual objects; every non-empty entry of
+	// the occupancy pyramid is a node, so the whole tree can be allocated at
+	// once
+	gen_numprops = gen_create_proplevels();
+	gen_numleaves = gen_numtreeleaves = gen_numbldgleaves = 0;
+	if (gen_numprops > 0) {
+		gen_proptree = malloc(sizeof(*gen_proptree) * gen_numprops);
+		gen_leaves = gen_scratch_alloc(sizeof(*gen_leaves) * gen_numprops);
+		gen_build_proptree(0, &next, gen_numproplevels - 1, 0, 0);
+		assert(next == gen_numprops);
+		assert(gen_numtreeleaves * TREES_PER_FIELD <= MAX_NUM_TREES
+			&& gen_numbldgleaves * BLDGS_PER_FIELD <= MAX_NUM_BLDGS);
+	}
+	if (!gen_legacy_rng)
+		ac_jobs_run(GEN_TREE_PATTERNS, 1, gen_make_tree_pattern, NULL, NULL);
+}
+
+/// \brief Lays out the props of a streamed heightmap ahead of its strips.
+/// The props don't depend on the heights for anything but their own, so
+/// \ref gen_terrain_strips can sample those off the strips as it goes, and
+/// \ref gen_proplists takes it from there. Does nothing if the props are
+/// going to be loaded from the cache.
+static void gen_plan_props(void) {
+	// the legacy generator draws its numbers in sequence, so its props can
+	// only be placed one after another, sampling the heightmap as they go
+	if (gen_legacy_rng || gen_cache_size(GEN_SECTION_PROPTREE) > 0)
+		return;
+
+	gen_free_proptree();
+	gen_layout_props();
+	gen_tree_heights = malloc(sizeof(*gen_tree_heights)
+		* (gen_numtreeleaves * TREES_PER_FIELD + 1));
+	gen_bldg_heights = malloc(sizeof(*gen_bldg_heights)
+		* (gen_numbldgleaves * BLDGS_PER_FIELD + 1));
+	gen_props_planned = true;
+}
+
+/// \brief Samples the heights of the props of a single leaf.
+/// The props are placed just like \ref gen_place_leaf does it, only to be
+/// thrown away but for their heights.
+static void gen_sample_leaf(void *ctx, int item) {
+	const gen_leaf_t *l = &gen_leaves[((const int *)ctx)[item]];
+	ac_prop_t node = gen_proptree[l->index];
+	ac_tree_t trees[TREES_PER_FIELD];
+	ac_bldg_t bldgs[BLDGS_PER_FIELD];
+	int i;
+
+	gen_place_props(&node, trees, bldgs, l->x, l->y, NULL);
+	for (i = 0; i < node.count; i++) {
+		if (node.type == PROP_TREES)
+			gen_tree_heights[l->slot + i] = trees[i].pos.f[1];
+		else
+			gen_bldg_heights[l->slot + i] = bldgs[i].pos.f[1];
+	}
+}
+
+/// \brief Samples the heights of the planned props off a heightmap strip.
+/// Only takes the props of the prop map squares that the strip covers in full,
+/// along with the row the bilinear filtering reads past their far edges.
+/// \param rows		heightmap rows, HEIGHTMAP_SIZE texels each
+/// \param y0		heightmap Y coordinate of the first row
+/// \param numRows	number of rows in the strip
+static void gen_sample_strip(const uchar *rows, int y0, int numRows) {
+	const size_t mark = gen_scratch_mark();
+	const int first = y0 >> PROPMAP_SHIFT;
+	// the last strip ends at the edge of the map, the others one row into the
+	// next square
+	const int end = y0 + numRows < HEIGHTMAP_SIZE
+		? (y0 + numRows - 1) >> PROPMAP_SHIFT : PROPMAP_SIZE;
+	int *items, i, n = 0;
+
+	if (!gen_props_planned || gen_numleaves == 0)
+		return;
+	assert((y0 & ((1 << PROPMAP_SHIFT) - 1)) == 0);
+
+	items = gen_scratch_alloc(sizeof(*items) * gen_numleaves);
+	for (i = 0; i < gen_numleaves; i++) {
+		if (gen_leaves[i].y >= first && gen_leaves[i].y < end)
+			items[n++] = i;
+	}
+	gen_strip_rows = rows;
+	gen_strip_y0 = y0;
+	gen_strip_numrows = numRows;
+	ac_jobs_run(n, 64, gen_sample_leaf, items, NULL);
+	gen_strip_rows = NULL;
+	gen_scratch_rewind(mark);
+}
+
+/// Releases the temporaries of the prop tree layout.
+static void gen_end_props(void) {
+	if (gen_propmap)
+		gen_scratch_reset();
+	gen_propmap = NULL;
+	gen_leaves = NULL;
+	gen_numproplevels = 0;
+	free(gen_tree_heights);
+	free(gen_bldg_heights);
+	gen_tree_heights = gen_bldg_heights = NULL;
+	gen_props_planned = false;
+}
+
+void gen_proplists(int *numTrees, ac_tree_t *trees,
+					int *numBldgs, ac_bldg_t *bldgs) {
+	gen_trees = trees;
+	gen_bldgs = bldgs;
+	// the prop tree of a streamed heightmap has been laid out along with it
+	if (!gen_props_planned) {
+		gen_free_proptree();
+		if (gen_load_proplists(numTrees, trees, numBldgs, bldgs)) {
+			gen_build_bldg_coll(*numBldgs);
+			return;
+		}
+		gen_layout_props();
+	}
+
+	*numTrees = 0;
+	*numBldgs = 0;
+	if (gen_numprops > 0)
+		gen_fill_proptree(numTrees, trees, numBldgs, bldgs);
+
+	gen_save_proplists(*numTrees, trees, *numBldgs, bldgs);
+	gen_build_bldg_coll(*numBldgs);
+
+	g_loading_tick();
+
+	gen_end_props();
+}
+
+int gen_load_ticks(void) {
+	// the prop geometry, and the prop texture unless it's cached
+	int ticks = gen_cache_size(GEN_SECTION_PROP_TEX) > 0 ? 1 : 2;
+
+	// a row at a time
+	if (gen_asset_size(GEN_SECTION_FX_TEX) == 0)
+		ticks += FX_TEXTURE_SIZE;
+	// a streamed heightmap is gone over in strips unless its overview map and
+	// height ranges are cached, whether its texels are cached or not
+	if (gen_store_wanted() ? gen_cache_size(GEN_SECTION_OVERVIEW) == 0
+		|| gen_cache_size(GEN_SECTION_RANGES) == 0
+		: gen_cache_size(GEN_SECTION_HEIGHTMAP) == 0)
+		ticks += HEIGHTMAP_SIZE;
+	// the two kinds of prop map walks, the leaf batches and the prop lists
+	if (gen_cache_size(GEN_SECTION_PROPTREE) == 0)
+		ticks += 2 + GEN_PLACE_BATCHES + 1;
+	return ticks;
+}
+
+void gen_free_proptree(void) {
+	free(gen_proptree);
+	gen_proptree = NULL;
+	gen_numprops = 0;
+	free(gen_bldg_coll.x);
+	free(gen_bldg_coll.cellStart);
+	free(gen_bldg_coll.cellBldgs);
+	free(gen_bldg_coll.cellTop);
+	memset(&gen_bldg_coll, 0, sizeof(gen_bldg_coll));
+}
+
+/// Queues a changed region of the heightmap for \ref gen_next_dirty_rect.
+static void gen_add_dirty_rect(int x0, int y0, int x1, int y1) {
+	int i, *r;
+
+	// merge it into a region it overlaps with or, if the queue is full, into
+	// the last one; uploading some unchanged texels is cheaper than keeping
+	// track of them
+	for (i = 0; i < gen_numdirty; i++) {
+		r = gen_dirty[i];
+		if (x0 <= r[2] + 1 && x1 >= r[0] - 1 && y0 <= r[3] + 1
+			&& y1 >= r[1] - 1)
+			break;
+	}
+	if (i == gen_numdirty && gen_numdirty < GEN_MAX_DIRTY_RECTS) {
+		r = gen_dirty[gen_numdirty++];
+		r[0] = x0;
+		r[1] = y0;
+		r[2] = x1;
+		r[3] = y1;
+		return;
+	}
+	r = gen_dirty[i < gen_numdirty ? i : gen_numdirty - 1];
+	r[0] = x0 < r[0] ? x0 : r[0];
+	r[1] = y0 < r[1] ? y0 : r[1];
+	r[2] = x1 > r[2] ? x1 : r[2];
+	r[3] = y1 > r[3] ? y1 : r[3];
+}
+
+bool gen_next_dirty_rect(int rect[4]) {
+	if (gen_numdirty == 0)
+		return false;
+	memcpy(rect, gen_dirty[--gen_numdirty], sizeof(gen_dirty[0]));
+	return true;
+}
+
+/// \brief Drops the props within a changed region of the heightmap onto the
+/// new surface and updates the bounds of the prop tree nodes above them.
+/// Only descends into the nodes overlapping the region.
+/// \param rect		heightmap region, inclusive
+/// \param x, y		prop map coordinates of the node's corner
+/// \param size		dimension of the node in prop map squares
+static void gen_settle_props(ac_prop_t *node, const int rect[4], int x, int y,
+								int size) {
+	ac_tree_t *trees;
+	ac_bldg_t *bldgs;
+	ac_prop_t *child;
+	int i, q, half;
+
+	// the props are bilinearly interpolated from the texels around them
+	if (((x + size) << PROPMAP_SHIFT) < rect[0] - 1
+		|| (x << PROPMAP_SHIFT) > rect[2] + 1
+		|| ((y + size) << PROPMAP_SHIFT) < rect[1] - 1
+		|| (y << PROPMAP_SHIFT) > rect[3] + 1)
+		return;
+
+	switch (node->type) {
+		case PROP_TREES:
+			trees = gen_trees + node->first;
+			for (i = 0; i < node->count; i++)
+				trees[i].pos.f[1] = gen_sample_height(
+					trees[i].pos.f[0] + HEIGHTMAP_SIZE * 0.5,
+					trees[i].pos.f[2] + HEIGHTMAP_SIZE * 0.5);
+			gen_leaf_bounds(node, trees, NULL);
+			break;
+		case PROP_BLDGS:
+			bldgs = gen_bldgs + node->first;
+			for (i = 0; i < node->count; i++) {
+				bldgs[i].pos.f[1] = gen_sample_height(
+					bldgs[i].pos.f[0] + HEIGHTMAP_SIZE * 0.5,
+					bldgs[i].pos.f[2] + HEIGHTMAP_SIZE * 0.5);
+				// the tops of the collision grid and its cells are left
+				// as they are, as the buildings only ever go down
+				gen_bldg_coll.y[node->first + i] = bldgs[i].pos.f[1]
+					- bldgs[i].Yscale + gen_bldg_coll.hy[node->first + i];
+			}
+			gen_leaf_bounds(node, NULL, bldgs);
+			break;
+		default:
+			half = size / 2;
+			node->bounds[0] = FLT_MAX;
+			node->bounds[1] = -FLT_MAX;
+			for (q = 0, child = gen_proptree + node->first; q < 4; q++) {
+				if (!(node->children & (1 << q)))
+					continue;
+				gen_settle_props(child, rect, x + (q & 1) * half,
+					y + (q >> 1) * half, half);
+				if (child->bounds[0] < node->bounds[0])
+					node->bounds[0] = child->bounds[0];
+				if (child->bounds[1] > node->bounds[1])
+					node->bounds[1] = child->bounds[1];
+				child++;
+			}
+			break;
+	}
+}
+
+bool gen_crater(float x, float y, float radius, float depth) {
+	const float r2 = radius * radius;
+	const float units = depth / HEIGHT_SCALE;
+	int rect[4] = {HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, -1, -1};
+	int tx, ty, tx0, ty0, tx1, ty1, dig;
+	float d2;
+	uchar *t;
+
+	// the chunks of a streamed heightmap are generated anew every time they're
+	// paged in, so any changes to them would be lost
+	if (!gen_heightmap || radius <= 0.f || depth <= 0.f)
+		return false;
+
+	tx0 = (int)ceilf(x - radius);
+	ty0 = (int)ceilf(y - radius);
+	tx1 = (int)floorf(x + radius);
+	ty1 = (int)floorf(y + radius);
+	tx0 = tx0 > 0 ? tx0 : 0;
+	ty0 = ty0 > 0 ? ty0 : 0;
+	tx1 = tx1 < HEIGHTMAP_SIZE - 1 ? tx1 : HEIGHTMAP_SIZE - 1;
+	ty1 = ty1 < HEIGHTMAP_SIZE - 1 ? ty1 : HEIGHTMAP_SIZE - 1;
+	for (ty = ty0; ty <= ty1; ty++) {
+		for (tx = tx0; tx <= tx1; tx++) {
+			d2 = (tx - x) * (tx - x) + (ty - y) * (ty - y);
+			if (d2 >= r2)
+				continue;
+			// a paraboloid bowl, deepest in the middle
+			dig = (int)(units * (1.f - d2 / r2) + 0.5f);
+			t = gen_heightmap + (size_t)ty * HEIGHTMAP_SIZE + tx;
+			if (dig <= 0 || *t == 0)
+				continue;
+			*t = *t > dig ? *t - dig : 0;
+			rect[0] = tx < rect[0] ? tx : rect[0];
+			rect[1] = ty < rect[1] ? ty : rect[1];
+			rect[2] = tx > rect[2] ? tx : rect[2];
+			rect[3] = ty > rect[3] ? ty : rect[3];
+		}
+	}
+	if (rect[2] < rect[0])
+		return false;
+
+	gen_range_update(gen_heightmap, rect[0], rect[1], rect[2], rect[3]);
+	if (gen_proptree)
+		gen_settle_props(gen_proptree, rect, 0, 0, PROPMAP_SIZE);
+	gen_add_dirty_rect(rect[0], rect[1], rect[2], rect[3]);
+	return true;
+}
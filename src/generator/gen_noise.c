@@ -0,0 +1,341 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Noise generation module; scalar and vectorized improved Perlin noise
+
+#include "gen_local.h"
+#include <string.h>
+#include <emmintrin.h>
+#ifdef __AVX2__
+	#include <immintrin.h>
+#endif
+
+// NOTE: the vectorized kernels repeat the exact sequence of floating point
+// operations of the scalar one, so that the terrain for a given seed stays the
+// same no matter which kernel generated it. Don't let the compiler contract
+// any of this into fused multiply-adds!
+#if defined(__clang__)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+	#pragma GCC optimize ("fp-contract=off")
+#endif
+// For the same reason, the scalar kernel mustn't run on the x87 FPU, which
+// keeps more precision than the SSE registers do.
+#if defined(__GNUC__) && defined(__i386__) && !defined(__SSE2_MATH__)
+	#error "Build the generator with -msse2 -mfpmath=sse"
+#endif
+
+/// Perlin noise permutation table.
+static int p[] = { 151,160,137,91,90,15,
+   131,13,201,95,96,53,194,233,7,225,140,36,103,30,69,142,8,99,37,240,21,10,23,
+   190, 6,148,247,120,234,75,0,26,197,62,94,252,219,203,117,35,11,32,57,177,33,
+   88,237,149,56,87,174,20,125,136,171,168, 68,175,74,165,71,134,139,48,27,166,
+   77,146,158,231,83,111,229,122,60,211,133,230,220,105,92,41,55,46,245,40,244,
+   102,143,54, 65,25,63,161, 1,216,80,73,209,76,132,187,208, 89,18,169,200,196,
+   135,130,116,188,159,86,164,100,109,198,173,186, 3,64,52,217,226,250,124,123,
+   5,202,38,147,118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,
+   223,183,170,213,119,248,152, 2,44,154,163, 70,221,153,101,155,167, 43,172,9,
+   129,22,39,253, 19,98,108,110,79,113,224,232,178,185, 112,104,218,246,97,228,
+   251,34,242,193,238,210,144,12,191,179,162,241, 81,51,145,235,249,14,239,107,
+   49,192,214, 31,181,199,106,157,184, 84,204,176,115,121,50,45,127, 4,150,254,
+   138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,61,156,180
+};
+
+#define fade(t)			((t) * (t) * (t) * ((t) * ((t) * 6 - 15) + 10))
+#define lerp(t, a, b)	((a) + (t) * ((b) - (a)))
+static inline float grad(int hash, float x, float y, float z) {
+	int h = hash & 15;	// convert low 4 bits of hash code into 12 gradient
+	float u = h < 8 ? x : y;	// directions
+	float v = h < 4 ? y : (h == 12 || h==14 ? x : z);
+	return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+float gen_perlin(float x, float y, float z) {
+	int X, Y, Z;
+	int A, AA, AB, B, BA, BB;
+	float u, v, w;
+	// find unit cube that contains point
+	X = (int)floorf(x) & 255;
+	Y = (int)floorf(y) & 255;
+	Z = (int)floorf(z) & 255;
+	// find relative x, y, z of point in cube
+	x -= floorf(x);
+	y -= floorf(y);
+	z -= floorf(z);
+	// compute fade curves for each of x, y, z
+	u = fade(x);
+	v = fade(y);
+	w = fade(z);
+	// hash coordinates of the 8 cube corners...
+	A  = p[X % 256] + Y;
+	AA = p[A % 256] + Z;
+	AB = p[(A + 1) % 256] + Z;
+	B  = p[(X + 1) % 256] + Y;
+	BA = p[B % 256] + Z;
+	BB = p[(B + 1) % 256]+Z;
+	// ...and add blended results from 8 corners of cube
+	return lerp(w, lerp(v,  lerp(u, grad(p[ AA    % 256], x  , y  , z   ),
+									grad(p[ BA    % 256], x-1, y  , z   )),
+							lerp(u, grad(p[ AB    % 256], x  , y-1, z   ),
+									grad(p[ BB    % 256], x-1, y-1, z   ))),
+					lerp(v, lerp(u, grad(p[(AA+1) % 256], x  , y  , z-1 ),
+									grad(p[(BA+1) % 256], x-1, y  , z-1 )),
+							lerp(u, grad(p[(AB+1) % 256], x  , y-1, z-1 ),
+									grad(p[(BB+1) % 256], x-1, y-1, z-1 ))));
+}
+#undef fade
+#undef lerp
+
+// =========================================================
+// SSE2 kernel
+// =========================================================
+
+/// Permutation table lookup; SSE2 has no gather, so do it lane by lane.
+static inline __m128i gen_gather4(__m128i idx) {
+	ALIGNED_16 int i[4];
+	_mm_store_si128((__m128i *)i, _mm_and_si128(idx, _mm_set1_epi32(255)));
+	return _mm_set_epi32(p[i[3]], p[i[2]], p[i[1]], p[i[0]]);
+}
+
+/// floorf() replacement; also returns the integer version of the result.
+static inline __m128 gen_floor4(__m128 x, __m128i *i) {
+	__m128i t = _mm_cvttps_epi32(x);
+	__m128 f = _mm_cvtepi32_ps(t);
+	// truncation rounds negative numbers up, so fix those lanes up
+	__m128 m = _mm_cmpgt_ps(f, x);
+	*i = _mm_add_epi32(t, _mm_castps_si128(m));	// true lanes are -1
+	return _mm_sub_ps(f, _mm_and_ps(m, _mm_set1_ps(1.f)));
+}
+
+static inline __m128 gen_fade4(__m128 t) {
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t),
+		_mm_add_ps(_mm_mul_ps(t,
+				_mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.f)), _mm_set1_ps(15.f))),
+			_mm_set1_ps(10.f)));
+}
+
+static inline __m128 gen_lerp4(__m128 t, __m128 a, __m128 b) {
+	return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+/// Branchless version of \ref grad.
+static inline __m128 gen_grad4(__m128i hash, __m128 x, __m128 y, __m128 z) {
+	__m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+	__m128 m, u, v;
+	// u = h < 8 ? x : y
+	m = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+	u = _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, y));
+	// v = h < 4 ? y : (h == 12 || h == 14 ? x : z)
+	m = _mm_castsi128_ps(_mm_or_si128(
+		_mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+		_mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+	v = _mm_or_ps(_mm_and_ps(m, x), _mm_andnot_ps(m, z));
+	m = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+	v = _mm_or_ps(_mm_and_ps(m, y), _mm_andnot_ps(m, v));
+	// bits 0 and 1 flip the signs of u and v, respectively
+	u = _mm_xor_ps(u, _mm_castsi128_ps(
+		_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31)));
+	v = _mm_xor_ps(v, _mm_castsi128_ps(
+		_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30)));
+	return _mm_add_ps(u, v);
+}
+
+void gen_perlin4(const float *px, const float *py, const float *pz,
+					float *out) {
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128i ione = _mm_set1_epi32(1);
+	__m128 x, y, z, x1, y1, z1, u, v, w;
+	__m128i X, Y, Z, A, AA, AB, B, BA, BB;
+
+	x = _mm_loadu_ps(px);
+	y = _mm_loadu_ps(py);
+	z = _mm_loadu_ps(pz);
+	// find unit cube that contains point and the relative x, y, z within it
+	x = _mm_sub_ps(x, gen_floor4(x, &X));
+	y = _mm_sub_ps(y, gen_floor4(y, &Y));
+	z = _mm_sub_ps(z, gen_floor4(z, &Z));
+	X = _mm_and_si128(X, _mm_set1_epi32(255));
+	Y = _mm_and_si128(Y, _mm_set1_epi32(255));
+	Z = _mm_and_si128(Z, _mm_set1_epi32(255));
+	x1 = _mm_sub_ps(x, one);
+	y1 = _mm_sub_ps(y, one);
+	z1 = _mm_sub_ps(z, one);
+	// compute fade curves for each of x, y, z
+	u = gen_fade4(x);
+	v = gen_fade4(y);
+	w = gen_fade4(z);
+	// hash coordinates of the 8 cube corners...
+	A  = _mm_add_epi32(gen_gather4(X), Y);
+	AA = _mm_add_epi32(gen_gather4(A), Z);
+	AB = _mm_add_epi32(gen_gather4(_mm_add_epi32(A, ione)), Z);
+	B  = _mm_add_epi32(gen_gather4(_mm_add_epi32(X, ione)), Y);
+	BA = _mm_add_epi32(gen_gather4(B), Z);
+	BB = _mm_add_epi32(gen_gather4(_mm_add_epi32(B, ione)), Z);
+	// ...and add blended results from 8 corners of cube
+	_mm_storeu_ps(out, gen_lerp4(w,
+		gen_lerp4(v,
+			gen_lerp4(u,
+				gen_grad4(gen_gather4(AA), x, y, z),
+				gen_grad4(gen_gather4(BA), x1, y, z)),
+			gen_lerp4(u,
+				gen_grad4(gen_gather4(AB), x, y1, z),
+				gen_grad4(gen_gather4(BB), x1, y1, z))),
+		gen_lerp4(v,
+			gen_lerp4(u,
+				gen_grad4(gen_gather4(_mm_add_epi32(AA, ione)), x, y, z1),
+				gen_grad4(gen_gather4(_mm_add_epi32(BA, ione)), x1, y, z1)),
+			gen_lerp4(u,
+				gen_grad4(gen_gather4(_mm_add_epi32(AB, ione)), x, y1, z1),
+				gen_grad4(gen_gather4(_mm_add_epi32(BB, ione)), x1, y1, z1)))));
+}
+
+// =========================================================
+// AVX2 kernel
+// =========================================================
+
+#ifdef __AVX2__
+static inline __m256i gen_gather8(__m256i idx) {
+	return _mm256_i32gather_epi32(p,
+		_mm256_and_si256(idx, _mm256_set1_epi32(255)), sizeof(p[0]));
+}
+
+static inline __m256 gen_floor8(__m256 x, __m256i *i) {
+	__m256i t = _mm256_cvttps_epi32(x);
+	__m256 f = _mm256_cvtepi32_ps(t);
+	__m256 m = _mm256_cmp_ps(f, x, _CMP_GT_OQ);
+	*i = _mm256_add_epi32(t, _mm256_castps_si256(m));
+	return _mm256_sub_ps(f, _mm256_and_ps(m, _mm256_set1_ps(1.f)));
+}
+
+static inline __m256 gen_fade8(__m256 t) {
+	return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t),
+		_mm256_add_ps(_mm256_mul_ps(t,
+				_mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.f)),
+					_mm256_set1_ps(15.f))),
+			_mm256_set1_ps(10.f)));
+}
+
+static inline __m256 gen_lerp8(__m256 t, __m256 a, __m256 b) {
+	return _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a)));
+}
+
+static inline __m256 gen_grad8(__m256i hash, __m256 x, __m256 y, __m256 z) {
+	__m256i h = _mm256_and_si256(hash, _mm256_set1_epi32(15));
+	__m256 m, u, v;
+	m = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(8), h));
+	u = _mm256_blendv_ps(y, x, m);
+	m = _mm256_castsi256_ps(_mm256_or_si256(
+		_mm256_cmpeq_epi32(h, _mm256_set1_epi32(12)),
+		_mm256_cmpeq_epi32(h, _mm256_set1_epi32(14))));
+	v = _mm256_blendv_ps(z, x, m);
+	m = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(4), h));
+	v = _mm256_blendv_ps(v, y, m);
+	u = _mm256_xor_ps(u, _mm256_castsi256_ps(
+		_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(1)), 31)));
+	v = _mm256_xor_ps(v, _mm256_castsi256_ps(
+		_mm256_slli_epi32(_mm256_and_si256(h, _mm256_set1_epi32(2)), 30)));
+	return _mm256_add_ps(u, v);
+}
+#endif // __AVX2__
+
+void gen_perlin8(const float *px, const float *py, const float *pz,
+					float *out) {
+#ifdef __AVX2__
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m256i ione = _mm256_set1_epi32(1);
+	__m256 x, y, z, x1, y1, z1, u, v, w;
+	__m256i X, Y, Z, A, AA, AB, B, BA, BB;
+
+	x = _mm256_loadu_ps(px);
+	y = _mm256_loadu_ps(py);
+	z = _mm256_loadu_ps(pz);
+	x = _mm256_sub_ps(x, gen_floor8(x, &X));
+	y = _mm256_sub_ps(y, gen_floor8(y, &Y));
+	z = _mm256_sub_ps(z, gen_floor8(z, &Z));
+	X = _mm256_and_si256(X, _mm256_set1_epi32(255));
+	Y = _mm256_and_si256(Y, _mm256_set1_epi32(255));
+	Z = _mm256_and_si256(Z, _mm256_set1_epi32(255));
+	x1 = _mm256_sub_ps(x, one);
+	y1 = _mm256_sub_ps(y, one);
+	z1 = _mm256_sub_ps(z, one);
+	u = gen_fade8(x);
+	v = gen_fade8(y);
+	w = gen_fade8(z);
+	A  = _mm256_add_epi32(gen_gather8(X), Y);
+	AA = _mm256_add_epi32(gen_gather8(A), Z);
+	AB = _mm256_add_epi32(gen_gather8(_mm256_add_epi32(A, ione)), Z);
+	B  = _mm256_add_epi32(gen_gather8(_mm256_add_epi32(X, ione)), Y);
+	BA = _mm256_add_epi32(gen_gather8(B), Z);
+	BB = _mm256_add_epi32(gen_gather8(_mm256_add_epi32(B, ione)), Z);
+	_mm256_storeu_ps(out, gen_lerp8(w,
+		gen_lerp8(v,
+			gen_lerp8(u,
+				gen_grad8(gen_gather8(AA), x, y, z),
+				gen_grad8(gen_gather8(BA), x1, y, z)),
+			gen_lerp8(u,
+				gen_grad8(gen_gather8(AB), x, y1, z),
+				gen_grad8(gen_gather8(BB), x1, y1, z))),
+		gen_lerp8(v,
+			gen_lerp8(u,
+				gen_grad8(gen_gather8(_mm256_add_epi32(AA, ione)), x, y, z1),
+				gen_grad8(gen_gather8(_mm256_add_epi32(BA, ione)), x1, y, z1)),
+			gen_lerp8(u,
+				gen_grad8(gen_gather8(_mm256_add_epi32(AB, ione)), x, y1, z1),
+				gen_grad8(gen_gather8(_mm256_add_epi32(BB, ione)), x1, y1, z1)))));
+#else
+	gen_perlin4(px, py, pz, out);
+	gen_perlin4(px + 4, py + 4, pz + 4, out + 4);
+#endif // __AVX2__
+}
+
+void gen_perlin_batch(const float *x, const float *y, const float *z,
+						float *out, size_t n) {
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		gen_perlin8(x + i, y + i, z + i, out + i);
+	for (; i + 4 <= n; i += 4)
+		gen_perlin4(x + i, y + i, z + i, out + i);
+	for (; i < n; i++)
+		out[i] = gen_perlin(x[i], y[i], z[i]);
+}
+
+/// Number of sample points used by \ref gen_perlin_check.
+#define CHECK_POINTS	4096
+
+bool gen_perlin_check(void) {
+	static int result = -1;
+	float x[CHECK_POINTS], y[CHECK_POINTS], z[CHECK_POINTS];
+	float ref[CHECK_POINTS], out[CHECK_POINTS];
+	uint state = 1;
+	int i;
+
+	if (result >= 0)
+		return result;
+
+	// use a private LCG, we mustn't disturb the generator's random sequence
+	for (i = 0; i < CHECK_POINTS; i++) {
+		state = state * 1664525 + 1013904223;
+		x[i] = (float)(int)(state >> 8) * (1.f / 4096.f) - 2048.f;
+		state = state * 1664525 + 1013904223;
+		y[i] = (float)(int)(state >> 8) * (1.f / 4096.f) - 2048.f;
+		state = state * 1664525 + 1013904223;
+		// also include integer lattice points, they're the corner cases
+		z[i] = i % 16 == 0 ? (float)(i / 16 - 128)
+			: (float)(int)(state >> 8) * (1.f / 65536.f) - 128.f;
+		ref[i] = gen_perlin(x[i], y[i], z[i]);
+	}
+
+	result = 1;
+	for (i = 0; i < CHECK_POINTS; i += 4)
+		gen_perlin4(x + i, y + i, z + i, out + i);
+	if (memcmp(ref, out, sizeof(ref)))
+		result = 0;
+	for (i = 0; i < CHECK_POINTS; i += 8)
+		gen_perlin8(x + i, y + i, z + i, out + i);
+	if (memcmp(ref, out, sizeof(ref)))
+		result = 0;
+	gen_perlin_batch(x, y, z, out, CHECK_POINTS - 3);
+	if (memcmp(ref, out, sizeof(ref[0]) * (CHECK_POINTS - 3)))
+		result = 0;
+	return result;
+}
@@ -0,0 +1,290 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// World pool module; pre-generates the worlds of the upcoming seeds into their
+// cache files in the background
+
+#include "gen_local.h"
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <sys/types.h>
+	#include <sys/resource.h>
+	#include <sys/wait.h>
+	#include <errno.h>
+	#include <signal.h>
+	#include <unistd.h>
+#endif
+
+/// Maximum length of the game executable path.
+#define GEN_POOL_MAX_PATH	1024
+
+// the generator keeps the world in global state, which the game keeps using
+// while the pool is working, so every world is generated by a separate,
+// headless instance of the game
+static struct {
+	SDL_Thread			*thread;
+	SDL_mutex			*lock;		///< protects everything below
+	SDL_cond			*wake;		///< signalled when there's new work
+	bool				quit;
+	bool				paused;		///< true to not start any more children
+	char				exe[GEN_POOL_MAX_PATH];
+	int					seed;		///< first seed to generate
+	int					count;		///< number of seeds to generate
+	int					next;		///< next seed to generate
+	int					threads;	///< worker threads of the children
+	gen_pool_priority_t	priority;
+#ifdef WIN32
+	HANDLE				child;		///< NULL if none
+#else
+	pid_t				child;		///< 0 if none
+#endif
+	int					childSeed;	///< seed the child generates
+} gen_pool;
+
+#ifdef WIN32
+/// Priority classes of the children, by \ref gen_pool_priority_t.
+static const DWORD gen_pool_classes[] = {
+	IDLE_PRIORITY_CLASS,
+	BELOW_NORMAL_PRIORITY_CLASS,
+	NORMAL_PRIORITY_CLASS
+};
+#endif
+
+void gen_pool_pregenerate(int seed) {
+	static uchar propTex[PROP_TEXTURE_SIZE * PROP_TEXTURE_SIZE];
+	static ac_vertex_t propVerts[TREE_BASE * 3 - 5
+		+ BLDG_FLAT_VERTS + BLDG_SLNT_VERTS];
+	static uchar propIndices[TREE_BASE * 3
+		+ BLDG_FLAT_INDICES + BLDG_SLNT_INDICES];
+	static uchar fxTex[2 * FX_TEXTURE_SIZE * FX_TEXTURE_SIZE];
+	ac_vertex_t fxVerts[4];
+	uchar fxIndices[4];
+	ac_tree_t *trees;
+	ac_bldg_t *bldgs;
+	int numTrees, numBldgs;
+
+	// same order as the game loads the world in, which loads everything from
+	// the cache if it's already valid
+	gen_open_world(seed);
+	gen_props(propTex, propVerts, propIndices);
+	gen_fx(fxTex, fxVerts, fxIndices);
+	gen_terrain(seed);
+	trees = malloc(sizeof(*trees) * MAX_NUM_TREES);
+	bldgs = malloc(sizeof(*bldgs) * MAX_NUM_BLDGS);
+	gen_proplists(&numTrees, trees, &numBldgs, bldgs);
+	gen_save_world();
+
+	free(trees);
+	free(bldgs);
+	gen_free_proptree();
+	gen_free_terrain();
+}
+
+/// Starts generating the given seed; returns false on failure.
+static bool gen_pool_spawn(int seed) {
+	// the world settings that affect the cache files
+	const unsigned budget = gen_store_get_budget() >> 20;
+	const char *legacy = gen_legacy_rng ? " -legacy" : "";
+	const char *pack = gen_cache_packing ? " -packcache" : "";
+#ifdef WIN32
+	char cmdLine[GEN_POOL_MAX_PATH + 128];
+	STARTUPINFOA si;
+	PROCESS_INFORMATION pi;
+
+	snprintf(cmdLine, sizeof(cmdLine),
+		"\"%s\" -pregen -seed %d -s %d -m %u -j %d%s%s", gen_pool.exe, seed,
+		HEIGHTMAP_SIZE, budget, gen_pool.threads, legacy, pack);
+	memset(&si, 0, sizeof(si));
+	si.cb = sizeof(si);
+	if (!CreateProcessA(NULL, cmdLine, NULL, NULL, FALSE,
+		gen_pool_classes[gen_pool.priority] | CREATE_NO_WINDOW, NULL, NULL,
+		&si, &pi))
+		return false;
+	CloseHandle(pi.hThread);
+	gen_pool.child = pi.hProcess;
+	gen_pool.childSeed = seed;
+#else
+	static const int niceness[] = {19, 10, 0};
+	char seedArg[16], sizeArg[16], budgetArg[16], threadsArg[16];
+	const char *opts[2] = {NULL, NULL};
+	int numOpts = 0;
+	pid_t pid;
+
+	snprintf(seedArg, sizeof(seedArg), "%d", seed);
+	snprintf(sizeArg, sizeof(sizeArg), "%d", HEIGHTMAP_SIZE);
+	snprintf(budgetArg, sizeof(budgetArg), "%u", budget);
+	snprintf(threadsArg, sizeof(threadsArg), "%d", gen_pool.threads);
+	if (*legacy)
+		opts[numOpts++] = legacy + 1;
+	if (*pack)
+		opts[numOpts++] = pack + 1;
+	pid = fork();
+	if (pid < 0)
+		return false;
+	if (pid == 0) {
+		// child process; lower the priority before anything else happens
+		setpriority(PRIO_PROCESS, 0, niceness[gen_pool.priority]);
+		execlp(gen_pool.exe, gen_pool.exe, "-pregen", "-seed", seedArg,
+			"-s", sizeArg, "-m", budgetArg, "-j", threadsArg,
+			opts[0], opts[1], (char *)NULL);
+		_exit(127);
+	}
+	gen_pool.child = pid;
+	gen_pool.childSeed = seed;
+#endif
+	return true;
+}
+
+/// \brief Waits for the current child process to exit.
+/// A child that has been terminated leaves its temporary cache files behind,
+/// so they're removed once it's gone.
+static void gen_pool_wait(void) {
+#ifdef WIN32
+	WaitForSingleObject(gen_pool.child, INFINITE);
+	SDL_LockMutex(gen_pool.lock);
+	gen_cache_remove_temp(gen_pool.childSeed, GetProcessId(gen_pool.child));
+	CloseHandle(gen_pool.child);
+	gen_pool.child = NULL;
+	SDL_UnlockMutex(gen_pool.lock);
+#else
+	siginfo_t info;
+
+	// leave the child unreaped until the lock is held, so that its PID can't
+	// be reused by the time gen_pool_stop sends it a signal
+	while (waitid(P_PID, gen_pool.child, &info, WEXITED | WNOWAIT) < 0
+		&& errno == EINTR)
+		continue;
+	SDL_LockMutex(gen_pool.lock);
+	gen_cache_remove_temp(gen_pool.childSeed, gen_pool.child);
+	waitpid(gen_pool.child, NULL, 0);
+	gen_pool.child = 0;
+	SDL_UnlockMutex(gen_pool.lock);
+#endif
+}
+
+/// Generates the seeds one after another; runs on the pool thread.
+static int gen_pool_thread(void *unused) {
+	(void)unused;	// shut up compiler
+
+	SDL_LockMutex(gen_pool.lock);
+	for (;;) {
+		// sleep while paused or once all the seeds have been generated, until
+		// the pool gets moved on
+		while (!gen_pool.quit && (gen_pool.paused
+			|| gen_pool.next >= gen_pool.seed + gen_pool.count))
+			SDL_CondWait(gen_pool.wake, gen_pool.lock);
+		if (gen_pool.quit || !gen_pool_spawn(gen_pool.next))
+			break;
+		gen_pool.next++;
+		SDL_UnlockMutex(gen_pool.lock);
+		gen_pool_wait();
+		SDL_LockMutex(gen_pool.lock);
+	}
+	SDL_UnlockMutex(gen_pool.lock);
+	return 0;
+}
+
+bool gen_pool_start(const char *exe, int seed, int count, int threads,
+					gen_pool_priority_t priority) {
+	assert(gen_pool.thread == NULL);
+	assert(priority >= GEN_POOL_IDLE && priority <= GEN_POOL_NORMAL);
+
+	if (count < 1 || strlen(exe) >= sizeof(gen_pool.exe))
+		return false;
+	strcpy(gen_pool.exe, exe);
+	gen_pool.seed = seed;
+	gen_pool.count = count;
+	gen_pool.next = seed;
+	gen_pool.threads = threads;
+	gen_pool.priority = priority;
+	gen_pool.quit = false;
+	gen_pool.paused = false;
+	if (!(gen_pool.lock = SDL_CreateMutex()))
+		return false;
+	if (!(gen_pool.wake = SDL_CreateCond())) {
+		SDL_DestroyMutex(gen_pool.lock);
+		gen_pool.lock = NULL;
+		return false;
+	}
+	gen_pool.thread = SDL_CreateThread(gen_pool_thread, "gen_pool", NULL);
+	if (!gen_pool.thread) {
+		SDL_DestroyCond(gen_pool.wake);
+		SDL_DestroyMutex(gen_pool.lock);
+		gen_pool.wake = NULL;
+		gen_pool.lock = NULL;
+		return false;
+	}
+	return true;
+}
+
+void gen_pool_pause(void) {
+	if (!gen_pool.thread)
+		return;
+	SDL_LockMutex(gen_pool.lock);
+	if (!gen_pool.paused && gen_pool.child) {
+		// the child keeps its progress, it just stops competing for the CPU
+#ifdef WIN32
+		SetPriorityClass(gen_pool.child, IDLE_PRIORITY_CLASS);
+#else
+		kill(gen_pool.child, SIGSTOP);
+#endif
+	}
+	gen_pool.paused = true;
+	SDL_UnlockMutex(gen_pool.lock);
+}
+
+/// Lets a paused child process carry on; the lock must be held.
+static void gen_pool_continue(void) {
+	if (!gen_pool.paused || !gen_pool.child)
+		return;
+#ifdef WIN32
+	SetPriorityClass(gen_pool.child, gen_pool_classes[gen_pool.priority]);
+#else
+	kill(gen_pool.child, SIGCONT);
+#endif
+}
+
+void gen_pool_resume(int seed) {
+	if (!gen_pool.thread)
+		return;
+	SDL_LockMutex(gen_pool.lock);
+	gen_pool_continue();
+	gen_pool.paused = false;
+	// the world being generated is finished either way; the seeds before the
+	// new first one are skipped, and those already generated aren't redone
+	gen_pool.seed = seed;
+	if (gen_pool.next < seed)
+		gen_pool.next = seed;
+	SDL_CondSignal(gen_pool.wake);
+	SDL_UnlockMutex(gen_pool.lock);
+}
+
+void gen_pool_stop(void) {
+	if (!gen_pool.thread)
+		return;
+	// don't wait for the current world to be finished; a partially written
+	// cache file is never renamed into place
+	SDL_LockMutex(gen_pool.lock);
+	gen_pool.quit = true;
+#ifdef WIN32
+	if (gen_pool.child)
+		TerminateProcess(gen_pool.child, 1);
+#else
+	if (gen_pool.child)
+		kill(gen_pool.child, SIGTERM);
+#endif
+	// a stopped child only acts on the signal once it's continued
+	gen_pool_continue();
+	SDL_CondSignal(gen_pool.wake);
+	SDL_UnlockMutex(gen_pool.lock);
+	SDL_WaitThread(gen_pool.thread, NULL);
+	SDL_DestroyCond(gen_pool.wake);
+	SDL_DestroyMutex(gen_pool.lock);
+	gen_pool.thread = NULL;
+	gen_pool.wake = NULL;
+	gen_pool.lock = NULL;
+}
@@ -0,0 +1,237 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Height range module; min/max pyramid of the heightmap
+
+#include "gen_local.h"
+#include <string.h>
+
+/// Dimension of a base cell of the pyramid in texels.
+#define GEN_RANGE_CELL		(1 << HEIGHT_RANGE_SHIFT)
+/// Maximum number of pyramid levels.
+#define GEN_RANGE_LEVELS	16
+
+// approximate heights come from the overview map, every texel of which must
+// fall within the base cell of the texel it stands in for
+#if GEN_OVERVIEW_SHIFT > HEIGHT_RANGE_SHIFT
+	#error The height range cells must not be smaller than the overview texels
+#endif
+
+static struct {
+	uchar	*data;	///< min/max pairs of all levels, finest first
+	int		numLevels;
+	int		offset[GEN_RANGE_LEVELS];	///< offsets of the levels in pairs
+	int		side[GEN_RANGE_LEVELS];		///< cells per level side
+	size_t	size;	///< size of the data in bytes
+} gen_range;
+
+/// Cell row job context.
+typedef struct {
+	const uchar	*rows;		///< heightmap rows, starting at y0
+	int			y0;
+	int			cy0;		///< first cell row to process
+} gen_range_rows_t;
+
+static inline uchar gen_range_min(uchar a, uchar b) {
+	return a < b ? a : b;
+}
+
+static inline uchar gen_range_max(uchar a, uchar b) {
+	return a > b ? a : b;
+}
+
+void gen_range_init(void) {
+	int i, side, total = 0;
+
+	gen_range_free();
+	for (i = 0, side = HEIGHTMAP_SIZE >> HEIGHT_RANGE_SHIFT; side > 0;
+		i++, side >>= 1) {
+		assert(i < GEN_RANGE_LEVELS);
+		gen_range.offset[i] = total;
+		gen_range.side[i] = side;
+		total += side * side;
+	}
+	gen_range.numLevels = i;
+	gen_range.size = total * 2;
+	gen_range.data = malloc(gen_range.size);
+}
+
+void gen_range_free(void) {
+	free(gen_range.data);
+	memset(&gen_range, 0, sizeof(gen_range));
+}
+
+/// Computes a single base cell out of the heightmap rows starting at rowsY.
+static void gen_range_base(const uchar *rows, int rowsY, int cx, int cy) {
+	const int x0 = cx << HEIGHT_RANGE_SHIFT;
+	const int y0 = cy << HEIGHT_RANGE_SHIFT;
+	// every cell includes the first texels of the next cells, so that it
+	// bounds the entire surface interpolated over it
+	const int x1 = x0 + GEN_RANGE_CELL < HEIGHTMAP_SIZE
+		? x0 + GEN_RANGE_CELL : HEIGHTMAP_SIZE - 1;
+	const int y1 = y0 + GEN_RANGE_CELL < HEIGHTMAP_SIZE
+		? y0 + GEN_RANGE_CELL : HEIGHTMAP_SIZE - 1;
+	uchar *out = gen_range.data
+		+ (gen_range.offset[0] + cy * gen_range.side[0] + cx) * 2;
+	const uchar *row;
+	int x, y;
+	uchar lo = 255, hi = 0;
+
+	for (y = y0; y <= y1; y++) {
+		row = rows + (size_t)(y - rowsY) * HEIGHTMAP_SIZE;
+		for (x = x0; x <= x1; x++) {
+			lo = gen_range_min(lo, row[x]);
+			hi = gen_range_max(hi, row[x]);
+		}
+	}
+	out[0] = lo;
+	out[1] = hi;
+}
+
+/// Computes a single row of base cells.
+static void gen_range_row(void *ctx, int item) {
+	const gen_range_rows_t *r = ctx;
+	int cx;
+
+	for (cx = 0; cx < gen_range.side[0]; cx++)
+		gen_range_base(r->rows, r->y0, cx, r->cy0 + item);
+}
+
+/// Computes the cells of a coarser level covering the given cells of the level
+/// below it.
+static void gen_range_merge(int level, int cx0, int cy0, int cx1, int cy1) {
+	const uchar *fine, *a, *b;
+	uchar *coarse;
+	const int side = gen_range.side[level];
+	int x, y;
+
+	fine = gen_range.data + gen_range.offset[level - 1] * 2;
+	for (y = cy0; y <= cy1; y++) {
+		coarse = gen_range.data
+			+ (gen_range.offset[level] + y * side + cx0) * 2;
+		for (x = cx0; x <= cx1; x++, coarse += 2) {
+			a = fine + (y * 2 * side * 2 + x * 2) * 2;
+			b = a + side * 2 * 2;
+			coarse[0] = gen_range_min(gen_range_min(a[0], a[2]),
+				gen_range_min(b[0], b[2]));
+			coarse[1] = gen_range_max(gen_range_max(a[1], a[3]),
+				gen_range_max(b[1], b[3]));
+		}
+	}
+}
+
+void gen_range_rows(const uchar *rows, int y0, int numRows) {
+	gen_range_rows_t r;
+	int cy1;
+
+	// only the cells whose texels are all in the given rows
+	r.rows = rows;
+	r.y0 = y0;
+	r.cy0 = (y0 + GEN_RANGE_CELL - 1) >> HEIGHT_RANGE_SHIFT;
+	if (y0 + numRows >= HEIGHTMAP_SIZE)
+		cy1 = gen_range.side[0];
+	else
+		cy1 = (y0 + numRows - 1 - GEN_RANGE_CELL) / GEN_RANGE_CELL + 1;
+	if (cy1 > r.cy0)
+		ac_jobs_run(cy1 - r.cy0, 1, gen_range_row, &r, NULL);
+}
+
+void gen_range_finish(void) {
+	int i;
+
+	for (i = 1; i < gen_range.numLevels; i++)
+		gen_range_merge(i, 0, 0, gen_range.side[i] - 1, gen_range.side[i] - 1);
+	// the base level makes up most of the pyramid, so predict the rows of
+	// that; the min/max pairs are interleaved
+	gen_cache_put_packed(GEN_SECTION_RANGES, gen_range.data, gen_range.size,
+		2, gen_range.side[0] * 2);
+}
+
+void gen_range_update(const uchar *heightmap, int x0, int y0, int x1,
+	int y1) {
+	int i, cx, cy, cx0, cy0, cx1, cy1;
+
+	if (!gen_range.data)
+		return;
+	// the cells share their edge texels with the preceding ones
+	cx0 = x0 > 0 ? (x0 - 1) >> HEIGHT_RANGE_SHIFT : 0;
+	cy0 = y0 > 0 ? (y0 - 1) >> HEIGHT_RANGE_SHIFT : 0;
+	cx1 = x1 >> HEIGHT_RANGE_SHIFT;
+	cy1 = y1 >> HEIGHT_RANGE_SHIFT;
+	cx1 = cx1 < gen_range.side[0] ? cx1 : gen_range.side[0] - 1;
+	cy1 = cy1 < gen_range.side[0] ? cy1 : gen_range.side[0] - 1;
+	for (cy = cy0; cy <= cy1; cy++) {
+		for (cx = cx0; cx <= cx1; cx++)
+			gen_range_base(heightmap, 0, cx, cy);
+	}
+	for (i = 1; i < gen_range.numLevels; i++) {
+		cx0 >>= 1;
+		cy0 >>= 1;
+		cx1 >>= 1;
+		cy1 >>= 1;
+		gen_range_merge(i, cx0, cy0, cx1, cy1);
+	}
+}
+
+bool gen_range_load(void) {
+	const uchar *cached;
+
+	gen_range_init();
+	if ((cached = gen_cache_get(GEN_SECTION_RANGES,
+		gen_range.size)) == NULL)
+		return false;
+	memcpy(gen_range.data, cached, gen_range.size);
+	return true;
+}
+
+int gen_height_range_levels(void) {
+	return gen_range.numLevels;
+}
+
+const uchar *gen_height_range_cell(int level, int x, int y) {
+	assert(level >= 0 && level < gen_range.numLevels);
+	assert(x >= 0 && x < gen_range.side[level]
+		&& y >= 0 && y < gen_range.side[level]);
+	return gen_range.data
+		+ (gen_range.offset[level] + y * gen_range.side[level] + x) * 2;
+}
+
+void gen_height_range(int x0, int y0, int x1, int y1, uchar range[2]) {
+	const uchar *c;
+	int level, extent, x, y;
+
+	if (!gen_range.data) {
+		range[0] = 0;
+		range[1] = 255;
+		return;
+	}
+
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 < HEIGHTMAP_SIZE ? x1 : HEIGHTMAP_SIZE - 1;
+	y1 = y1 < HEIGHTMAP_SIZE ? y1 : HEIGHTMAP_SIZE - 1;
+	if (x1 < x0 || y1 < y0) {
+		range[0] = 255;
+		range[1] = 0;
+		return;
+	}
+
+	// pick the level at which the region spans at most 2x2 cells
+	extent = (x1 - x0 > y1 - y0 ? x1 - x0 : y1 - y0) >> HEIGHT_RANGE_SHIFT;
+	for (level = 0; extent > 0 && level < gen_range.numLevels - 1; level++)
+		extent >>= 1;
+	x0 >>= HEIGHT_RANGE_SHIFT + level;
+	y0 >>= HEIGHT_RANGE_SHIFT + level;
+	x1 >>= HEIGHT_RANGE_SHIFT + level;
+	y1 >>= HEIGHT_RANGE_SHIFT + level;
+
+	range[0] = 255;
+	range[1] = 0;
+	for (y = y0; y <= y1; y++) {
+		for (x = x0; x <= x1; x++) {
+			c = gen_height_range_cell(level, x, y);
+			range[0] = gen_range_min(range[0], c[0]);
+			range[1] = gen_range_max(range[1], c[1]);
+		}
+	}
+}
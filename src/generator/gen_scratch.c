@@ -0,0 +1,97 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Scratch memory module; linear arena for the temporary buffers of the
+// generator stages
+
+#include "gen_local.h"
+#include <stdint.h>
+#include <string.h>
+
+/// \brief Minimum size of an arena block in bytes.
+/// Larger requests get blocks of their own, so that most stages only take a
+/// handful of blocks.
+#define GEN_SCRATCH_BLOCK	(1 << 20)
+/// Alignment of the allocations; enough for SSE vectors.
+#define GEN_SCRATCH_ALIGN	16
+
+/// Arena block; the allocations follow the header.
+typedef struct gen_scratch_block_s {
+	struct gen_scratch_block_s	*prev;	///< block below this one, NULL if none
+	uchar						*data;	///< aligned start of the allocations
+	size_t						start;	///< arena position of the data
+	size_t						size;	///< capacity of the block in bytes
+} gen_scratch_block_t;
+
+// the arena positions grow monotonically through the stack of blocks, so that
+// a position identifies both the block and the offset within it
+static struct {
+	gen_scratch_block_t	*top;		///< current block, NULL if none
+	size_t				pos;		///< position of the next allocation
+	size_t				reserved;	///< total capacity of the blocks
+	size_t				peak;		///< peak of reserved
+} gen_scratch;
+
+void *gen_scratch_alloc(size_t size) {
+	gen_scratch_block_t *b = gen_scratch.top;
+	size_t blockSize;
+	void *p;
+
+	size = (size + GEN_SCRATCH_ALIGN - 1) & ~(size_t)(GEN_SCRATCH_ALIGN - 1);
+	if (!b || gen_scratch.pos + size > b->start + b->size) {
+		// whatever is left of the current block is wasted until it's rewound
+		blockSize = size > GEN_SCRATCH_BLOCK ? size : GEN_SCRATCH_BLOCK;
+		if (!(b = malloc(sizeof(*b) + GEN_SCRATCH_ALIGN + blockSize)))
+			return NULL;
+		b->data = (uchar *)(((uintptr_t)(b + 1) + GEN_SCRATCH_ALIGN - 1)
+			& ~(uintptr_t)(GEN_SCRATCH_ALIGN - 1));
+		b->prev = gen_scratch.top;
+		b->start = b->prev ? b->prev->start + b->prev->size : 0;
+		b->size = blockSize;
+		gen_scratch.top = b;
+		gen_scratch.pos = b->start;
+		gen_scratch.reserved += blockSize;
+		if (gen_scratch.peak < gen_scratch.reserved)
+			gen_scratch.peak = gen_scratch.reserved;
+	}
+	p = b->data + (gen_scratch.pos - b->start);
+	gen_scratch.pos += size;
+	return p;
+}
+
+void *gen_scratch_calloc(size_t count, size_t size) {
+	void *p = gen_scratch_alloc(count * size);
+
+	if (p)
+		memset(p, 0, count * size);
+	return p;
+}
+
+size_t gen_scratch_mark(void) {
+	return gen_scratch.pos;
+}
+
+void gen_scratch_rewind(size_t mark) {
+	gen_scratch_block_t *b;
+
+	assert(mark <= gen_scratch.pos);
+	// free the blocks that have been started past the mark
+	while ((b = gen_scratch.top) != NULL && b->start >= mark) {
+		gen_scratch.top = b->prev;
+		gen_scratch.reserved -= b->size;
+		free(b);
+	}
+	gen_scratch.pos = mark;
+}
+
+void gen_scratch_reset(void) {
+	gen_scratch_rewind(0);
+}
+
+void gen_scratch_reset_peak(void) {
+	gen_scratch.peak = gen_scratch.reserved;
+}
+
+size_t gen_scratch_peak(void) {
+	return gen_scratch.peak;
+}
@@ -0,0 +1,367 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Terrain store module; streams the heightmap in chunks if it's too large to be
+// kept in memory in its entirety
+
+#include "gen_local.h"
+#include <stdio.h>
+#include <string.h>
+
+/// Bit mask of the texel coordinates within a chunk.
+#define GEN_CHUNK_MASK		(GEN_CHUNK_SIZE - 1)
+/// Minimum number of resident chunks, regardless of the memory budget.
+#define GEN_MIN_CHUNKS		128
+
+/// \brief Terrain store chunk.
+/// The pending flags are only ever changed by the game thread, under the lock.
+typedef struct {
+	uchar	*data;		///< texels, NULL if the chunk is not resident
+	uint	lastUse;	///< access stamp of the last use, for LRU eviction
+	bool	pending;	///< queued for generation in the background
+} gen_chunk_t;
+
+/// Chunk finished in the background.
+typedef struct {
+	int		index;
+	uchar	*data;
+} gen_chunk_result_t;
+
+static size_t		gen_store_budget = DEFAULT_TERRAIN_BUDGET;
+
+static struct {
+	bool					active;
+	gen_terrain_params_t	params;
+	const uchar				*source;	///< full heightmap to copy from
+	uchar					*overview;
+	int						side;		///< chunks per heightmap side
+	gen_chunk_t				*chunks;
+	int						*resident;	///< indices of resident chunks
+	int						numResident;
+	int						maxResident;
+	uint					stamp;		///< current access stamp
+
+	// background generation; everything below is protected by the lock
+	SDL_Thread				*thread;
+	SDL_mutex				*lock;
+	SDL_cond				*wake;
+	bool					quit;
+	int						ringSize;	///< capacity of the ring buffers
+	int						*requests;	///< ring buffer of chunk indices
+	int						reqHead, reqTail;
+	gen_chunk_result_t		*results;	///< ring buffer of finished chunks
+	int						resHead, resTail;
+} gen_store;
+
+void gen_set_terrain_budget(size_t bytes) {
+	gen_store_budget = bytes;
+}
+
+size_t gen_store_get_budget(void) {
+	return gen_store_budget;
+}
+
+bool gen_store_wanted(void) {
+	return (size_t)HEIGHTMAP_SIZE * HEIGHTMAP_SIZE > gen_store_budget;
+}
+
+/// Creates the texels of the given chunk.
+static uchar *gen_store_make(int index) {
+	const int cx = (index % gen_store.side) << GEN_CHUNK_SHIFT;
+	const int cy = (index / gen_store.side) << GEN_CHUNK_SHIFT;
+	uchar *data = malloc(GEN_CHUNK_SIZE * GEN_CHUNK_SIZE);
+	int i;
+
+	if (!data)
+		return NULL;
+	if (gen_store.source) {
+		for (i = 0; i < GEN_CHUNK_SIZE; i++)
+			memcpy(data + i * GEN_CHUNK_SIZE,
+				gen_store.source + (size_t)(cy + i) * HEIGHTMAP_SIZE + cx,
+				GEN_CHUNK_SIZE);
+	} else
+		gen_terrain_block(&gen_store.params, data, cx, cy,
+			GEN_CHUNK_SIZE, GEN_CHUNK_SIZE, 1, NULL);
+	return data;
+}
+
+static int gen_store_thread(void *unused) {
+	int index;
+	uchar *data;
+
+	(void)unused;	// shut up compiler
+
+	SDL_LockMutex(gen_store.lock);
+	while (!gen_store.quit) {
+		if (gen_store.reqHead == gen_store.reqTail) {
+			SDL_CondWait(gen_store.wake, gen_store.lock);
+			continue;
+		}
+		index = gen_store.requests[gen_store.reqHead];
+		gen_store.reqHead = (gen_store.reqHead + 1) % gen_store.ringSize;
+		SDL_UnlockMutex(gen_store.lock);
+
+		data = gen_store_make(index);
+
+		SDL_LockMutex(gen_store.lock);
+		gen_store.results[gen_store.resTail].index = index;
+		gen_store.results[gen_store.resTail].data = data;
+		gen_store.resTail = (gen_store.resTail + 1) % gen_store.ringSize;
+	}
+	SDL_UnlockMutex(gen_store.lock);
+	return 0;
+}
+
+void gen_store_init(const gen_terrain_params_t *p, const uchar *source) {
+	const int ovSize = HEIGHTMAP_SIZE >> GEN_OVERVIEW_SHIFT;
+	int i, numChunks;
+
+	gen_store_shutdown();
+
+	gen_store.params = *p;
+	gen_store.source = source;
+	gen_store.side = HEIGHTMAP_SIZE >> GEN_CHUNK_SHIFT;
+	numChunks = gen_store.side * gen_store.side;
+	gen_store.maxResident = gen_store_budget
+		/ (GEN_CHUNK_SIZE * GEN_CHUNK_SIZE);
+	if (gen_store.maxResident < GEN_MIN_CHUNKS)
+		gen_store.maxResident = GEN_MIN_CHUNKS;
+	if (gen_store.maxResident > numChunks)
+		gen_store.maxResident = numChunks;
+	gen_store.numResident = 0;
+	gen_store.stamp = 0;
+
+	gen_store.overview = malloc(ovSize * ovSize);
+	gen_store.chunks = malloc(sizeof(*gen_store.chunks) * numChunks);
+	gen_store.resident = malloc(sizeof(*gen_store.resident)
+		* gen_store.maxResident);
+	// every chunk may only be queued once, so this is enough for all of them
+	gen_store.ringSize = numChunks + 1;
+	gen_store.requests = malloc(sizeof(*gen_store.requests)
+		* gen_store.ringSize);
+	gen_store.results = malloc(sizeof(*gen_store.results) * gen_store.ringSize);
+	for (i = 0; i < numChunks; i++) {
+		gen_store.chunks[i].data = NULL;
+		gen_store.chunks[i].lastUse = 0;
+		gen_store.chunks[i].pending = false;
+	}
+	gen_store.reqHead = gen_store.reqTail = 0;
+	gen_store.resHead = gen_store.resTail = 0;
+
+	gen_store.quit = false;
+	gen_store.lock = SDL_CreateMutex();
+	gen_store.wake = SDL_CreateCond();
+	gen_store.thread = SDL_CreateThread(gen_store_thread, "gen_store", NULL);
+	// without the thread, chunks are generated one per stream update
+	if (!gen_store.thread)
+		fprintf(stderr, "Unable to start terrain streaming thread\n");
+	gen_store.active = true;
+}
+
+uchar *gen_store_overview(void) {
+	return gen_store.active ? gen_store.overview : NULL;
+}
+
+void gen_store_shutdown(void) {
+	int i;
+
+	if (!gen_store.active)
+		return;
+
+	if (gen_store.thread) {
+		SDL_LockMutex(gen_store.lock);
+		gen_store.quit = true;
+		SDL_CondSignal(gen_store.wake);
+		SDL_UnlockMutex(gen_store.lock);
+		SDL_WaitThread(gen_store.thread, NULL);
+		gen_store.thread = NULL;
+	}
+	SDL_DestroyCond(gen_store.wake);
+	SDL_DestroyMutex(gen_store.lock);
+
+	for (; gen_store.resHead != gen_store.resTail; gen_store.resHead =
+		(gen_store.resHead + 1) % gen_store.ringSize)
+		free(gen_store.results[gen_store.resHead].data);
+	for (i = 0; i < gen_store.numResident; i++)
+		free(gen_store.chunks[gen_store.resident[i]].data);
+	free(gen_store.results);
+	free(gen_store.requests);
+	free(gen_store.resident);
+	free(gen_store.chunks);
+	free(gen_store.overview);
+	memset(&gen_store, 0, sizeof(gen_store));
+}
+
+/// Makes the chunk resident, evicting the least recently used one if needed.
+static void gen_store_insert(int index, uchar *data) {
+	gen_chunk_t *c = &gen_store.chunks[index], *lru;
+	int i, slot;
+
+	if (c->data) {
+		// already there, e.g. loaded synchronously in the meantime
+		free(data);
+		return;
+	}
+
+	if (gen_store.numResident < gen_store.maxResident)
+		slot = gen_store.numResident++;
+	else {
+		slot = 0;
+		for (i = 1; i < gen_store.numResident; i++) {
+			if (gen_store.chunks[gen_store.resident[i]].lastUse
+				< gen_store.chunks[gen_store.resident[slot]].lastUse)
+				slot = i;
+		}
+		lru = &gen_store.chunks[gen_store.resident[slot]];
+		free(lru->data);
+		lru->data = NULL;
+	}
+	gen_store.resident[slot] = index;
+	c->data = data;
+	c->lastUse = gen_store.stamp;
+}
+
+/// Returns the chunk containing the given texel, loading it if necessary.
+static gen_chunk_t *gen_store_fetch(int x, int y) {
+	const int index = (y >> GEN_CHUNK_SHIFT) * gen_store.side
+		+ (x >> GEN_CHUNK_SHIFT);
+	gen_chunk_t *c = &gen_store.chunks[index];
+	uchar *data;
+
+	if (!c->data) {
+		// can't wait for the background thread, do it ourselves
+		data = gen_store_make(index);
+		assert(data != NULL);
+		gen_store.stamp++;
+		gen_store_insert(index, data);
+	}
+	c->lastUse = gen_store.stamp;
+	return c;
+}
+
+uchar gen_height(int x, int y) {
+	assert(x >= 0 && x < HEIGHTMAP_SIZE && y >= 0 && y < HEIGHTMAP_SIZE);
+	if (gen_heightmap)
+		return gen_heightmap[y * HEIGHTMAP_SIZE + x];
+	return gen_store_fetch(x, y)->data[((y & GEN_CHUNK_MASK)
+		<< GEN_CHUNK_SHIFT) + (x & GEN_CHUNK_MASK)];
+}
+
+/// \brief Queues the chunk for generation in the background.
+/// Must be called with the lock held.
+static void gen_store_request(int index) {
+	gen_chunk_t *c = &gen_store.chunks[index];
+
+	if (c->data || c->pending || !gen_store.thread)
+		return;
+	c->pending = true;
+	gen_store.requests[gen_store.reqTail] = index;
+	gen_store.reqTail = (gen_store.reqTail + 1) % gen_store.ringSize;
+}
+
+uchar gen_height_approx(int x, int y) {
+	const int index = (y >> GEN_CHUNK_SHIFT) * gen_store.side
+		+ (x >> GEN_CHUNK_SHIFT);
+	gen_chunk_t *c;
+
+	assert(x >= 0 && x < HEIGHTMAP_SIZE && y >= 0 && y < HEIGHTMAP_SIZE);
+	if (gen_heightmap)
+		return gen_heightmap[y * HEIGHTMAP_SIZE + x];
+	c = &gen_store.chunks[index];
+	if (c->data) {
+		c->lastUse = gen_store.stamp;
+		return c->data[((y & GEN_CHUNK_MASK) << GEN_CHUNK_SHIFT)
+			+ (x & GEN_CHUNK_MASK)];
+	}
+	// somebody needs this chunk after all, so have it generated
+	if (!c->pending && gen_store.thread) {
+		SDL_LockMutex(gen_store.lock);
+		gen_store_request(index);
+		SDL_CondSignal(gen_store.wake);
+		SDL_UnlockMutex(gen_store.lock);
+	}
+	return gen_store.overview[(y >> GEN_OVERVIEW_SHIFT)
+		* (HEIGHTMAP_SIZE >> GEN_OVERVIEW_SHIFT) + (x >> GEN_OVERVIEW_SHIFT)];
+}
+
+void gen_stream_update(float x, float z, float radius) {
+	int i, j, r, step, cx, cy, rings, x0, x1, y0, y1, index, missing = -1;
+	gen_chunk_t *c;
+	uchar *data;
+
+	if (!gen_store.active)
+		return;
+
+	gen_store.stamp++;
+
+	// pick up the chunks finished in the background
+	SDL_LockMutex(gen_store.lock);
+	while (gen_store.resHead != gen_store.resTail) {
+		index = gen_store.results[gen_store.resHead].index;
+		gen_store.chunks[index].pending = false;
+		if (gen_store.results[gen_store.resHead].data)
+			gen_store_insert(index, gen_store.results[gen_store.resHead].data);
+		gen_store.resHead = (gen_store.resHead + 1) % gen_store.ringSize;
+	}
+
+	// request the chunks around the given point that are missing and keep the
+	// rest of them from being evicted
+	x += HEIGHTMAP_SIZE / 2;
+	z += HEIGHTMAP_SIZE / 2;
+	x0 = x - radius < 0.f ? 0 : (int)(x - radius) >> GEN_CHUNK_SHIFT;
+	y0 = z - radius < 0.f ? 0 : (int)(z - radius) >> GEN_CHUNK_SHIFT;
+	x1 = x + radius >= HEIGHTMAP_SIZE ? gen_store.side - 1
+		: (int)(x + radius) >> GEN_CHUNK_SHIFT;
+	y1 = z + radius >= HEIGHTMAP_SIZE ? gen_store.side - 1
+		: (int)(z + radius) >> GEN_CHUNK_SHIFT;
+	if (x0 > x1 || y0 > y1) {
+		SDL_UnlockMutex(gen_store.lock);
+		return;
+	}
+	// go in rings around the point, so that the nearest chunks come first
+	cx = x < 0.f ? x0 : ((int)x >> GEN_CHUNK_SHIFT > x1 ? x1
+		: (int)x >> GEN_CHUNK_SHIFT);
+	cy = z < 0.f ? y0 : ((int)z >> GEN_CHUNK_SHIFT > y1 ? y1
+		: (int)z >> GEN_CHUNK_SHIFT);
+	rings = cx - x0;
+	if (rings < x1 - cx)
+		rings = x1 - cx;
+	if (rings < cy - y0)
+		rings = cy - y0;
+	if (rings < y1 - cy)
+		rings = y1 - cy;
+	for (r = 0; r <= rings; r++) {
+		for (j = cy - r; j <= cy + r; j++) {
+			if (j < y0 || j > y1)
+				continue;
+			// only the first and last rows of a ring are full
+			step = j == cy - r || j == cy + r ? 1 : 2 * r;
+			for (i = cx - r; i <= cx + r; i += step) {
+				if (i < x0 || i > x1)
+					continue;
+				index = j * gen_store.side + i;
+				c = &gen_store.chunks[index];
+				c->lastUse = gen_store.stamp;
+				if (!c->data && missing < 0)
+					missing = index;
+				gen_store_request(index);
+			}
+		}
+	}
+	SDL_CondSignal(gen_store.wake);
+	SDL_UnlockMutex(gen_store.lock);
+
+	// without the thread, make the nearest missing chunk ourselves
+	if (!gen_store.thread && missing >= 0
+		&& (data = gen_store_make(missing)) != NULL)
+		gen_store_insert(missing, data);
+}
+
+const uchar *gen_terrain_texture(int *size) {
+	if (gen_heightmap) {
+		*size = HEIGHTMAP_SIZE;
+		return gen_heightmap;
+	}
+	*size = HEIGHTMAP_SIZE >> GEN_OVERVIEW_SHIFT;
+	return gen_store.overview;
+}
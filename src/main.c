@@ -6,6 +6,7 @@
 #include <string.h>
 #include <time.h>
 #include "ac130.h"
+#include "ac_jobs.h"
 
 int m_screen_width = 0;
 int m_screen_height = 0;
@@ -17,6 +18,19 @@ bool m_compatshader = false;
 
 float m_rumble_intensity;
 
+int m_seed = 0xDEADBEEF;
+
+/// Number of worker threads, negative for one less than there are CPU cores.
+static int m_jobs = -1;
+/// True to generate the world's cache file and quit (see \ref gen_pool_start).
+static bool m_pregen = false;
+/// Number of upcoming seeds for the world pool to pre-generate.
+static int m_pool_size = 0;
+/// Number of worker threads of every world pool instance.
+static int m_pool_threads = 1;
+/// Scheduling priority of the world pool instances.
+static gen_pool_priority_t m_pool_priority = GEN_POOL_IDLE;
+
 static void parse_args(int argc, char *argv[]) {
 	int i;
 
@@ -47,12 +61,62 @@ static void parse_args(int argc, char *argv[]) {
 			m_compatshader = true;
 			continue;
 		}
+		// the default generator places different props than older versions
+		// did, this brings the old ones back
+		if (!strcmp(argv[i], "-legacy")) {
+			gen_set_legacy_rng(true);
+			continue;
+		}
+		if (!strcmp(argv[i], "-packcache")) {
+			gen_set_cache_packing(true);
+			continue;
+		}
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			int size = atoi(argv[++i]);
+			if (!gen_set_heightmap_size(size))
+				fprintf(stderr, "Invalid world size %d, must be a power of 2 "
+					"between %d and %d\n", size, MIN_HEIGHTMAP_SIZE,
+					MAX_HEIGHTMAP_SIZE);
+			continue;
+		}
+		if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+			int budget = atoi(argv[++i]);
+			if (budget > 0)
+				gen_set_terrain_budget((size_t)budget << 20);
+			continue;
+		}
 		if (!strcmp(argv[i], "-t") && i + 1 < argc) {
 			m_terrain_LOD = atof(argv[++i]);
 			if (m_terrain_LOD < 1.f)
 				m_terrain_LOD = 1.f;
 			continue;
 		}
+		if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+			m_seed = (int)strtoul(argv[++i], NULL, 0);
+			continue;
+		}
+		if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			m_jobs = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-pregen")) {
+			m_pregen = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "-pool") && i + 1 < argc) {
+			m_pool_size = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-poolthreads") && i + 1 < argc) {
+			m_pool_threads = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-poolprio") && i + 1 < argc) {
+			int prio = atoi(argv[++i]);
+			if (prio >= GEN_POOL_IDLE && prio <= GEN_POOL_NORMAL)
+				m_pool_priority = prio;
+			continue;
+		}
 	}
 }
 
@@ -98,6 +162,7 @@ int main (int argc, char *argv[]) {
 	ac_input_t	prevInput;
 	ac_input_t	curInput;
 	bool		done;
+	bool		switchWorld;
 	uint		frameCount = 0;
 	uint		vertCount = 0;
 	uint		triCount = 0;
@@ -111,6 +176,16 @@ int main (int argc, char *argv[]) {
 
 	parse_args(argc, argv);
 
+	// world pool instance; generate the world without ever opening a window
+	if (m_pregen) {
+		if (!ac_jobs_init(m_jobs))
+			fprintf(stderr, "Unable to start worker threads, "
+				"generating serially\n");
+		gen_pool_pregenerate(m_seed);
+		ac_jobs_shutdown();
+		return 0;
+	}
+
 	// initialize SDL
 	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER
 		| SDL_INIT_GAMECONTROLLER | SDL_INIT_HAPTIC) < 0) {
@@ -118,6 +193,13 @@ int main (int argc, char *argv[]) {
 		return 1;
 	}
 
+	// spin up the worker threads for content generation
+	if (!ac_jobs_init(m_jobs))
+		fprintf(stderr, "Unable to start worker threads, generating serially\n");
+
+	// map the world cache, if any, before the renderer asks for its assets
+	gen_open_world(m_seed);
+
 	// initialize renderer
 	if (!r_init(&vertCount, &triCount, &dpCount, &cpCount)) {
 		fprintf(stderr, "Unable to init renderer\n");
@@ -156,6 +238,11 @@ int main (int argc, char *argv[]) {
 	// update window caption to say that we're done generating stuff
 	SDL_SetWindowTitle(r_screen, "AC-130");
 
+	// now that the world is loaded, let the idle cores generate the next ones
+	if (m_pool_size > 0 && !gen_pool_start(argv[0], m_seed + 1, m_pool_size,
+		m_pool_threads, m_pool_priority))
+		fprintf(stderr, "Unable to start the world pool\n");
+
 	memset(&prevInput, 0, sizeof(prevInput));
 
 	// initialize tick counter
@@ -189,6 +276,7 @@ int main (int argc, char *argv[]) {
 		prevTime = curTime;
 
 		memset(&curInput, 0, sizeof(curInput));
+		switchWorld = false;
 		// copy buttons from last frame in case there was no MOUSEBUTTONUP event
 		curInput.flags |= prevInput.flags
 			& (INPUT_MOUSE_LEFT | INPUT_MOUSE_RIGHT);
@@ -219,6 +307,9 @@ int main (int argc, char *argv[]) {
 						case SDLK_p:
 							curInput.flags |= INPUT_PAUSE;
 							break;
+						case SDLK_n:
+							switchWorld = true;
+							break;
 #ifndef NDEBUG
 						case SDLK_g:
 							grab = !grab;
@@ -327,6 +418,22 @@ int main (int argc, char *argv[]) {
 			frameCount = triCount = vertCount = dpCount = cpCount = 0;
 		}
 
+		// move on to the next seed; the world pool has most likely made its
+		// world already
+		if (switchWorld) {
+			SDL_SetWindowTitle(r_screen,
+				"AC-130 - Generating resources, please wait...");
+			// keep the pool from competing with the load, then have it carry
+			// on ahead of the new world
+			gen_pool_pause();
+			g_switch_world(m_seed + 1);
+			gen_pool_resume(m_seed + 1);
+			SDL_SetWindowTitle(r_screen, "AC-130");
+			// don't count the loading time in as frame time
+			prevTime = SDL_GetTicks();
+			continue;
+		}
+
 		g_frame(curTime, frameTime, &curInput);
 		prevInput = curInput;
 		frameCount++;
@@ -342,8 +449,10 @@ int main (int argc, char *argv[]) {
     SDL_SetRelativeMouseMode(SDL_FALSE);
 
 	// shut all subsystems down
+	gen_pool_stop();
 	r_shutdown();
 	g_shutdown();
+	ac_jobs_shutdown();
 
 	return 0;
 }
@@ -9,17 +9,27 @@
 uint		r_fx_tex;
 uint		r_fx_VBOs[2];
 
+// CPU-side FX resources, made by r_generate_fx
+static ac_vertex_t	r_fx_verts[4];
+static uchar		r_fx_indices[4];
+static uchar		r_fx_texels[2 * FX_TEXTURE_SIZE * FX_TEXTURE_SIZE];
+
+void r_generate_fx(void) {
+	gen_fx(r_fx_texels, r_fx_verts, r_fx_indices);
+}
+
 void r_create_fx(void) {
-	ac_vertex_t	verts[4];
-	uchar		indices[4];
-	uchar		texture[2 * FX_TEXTURE_SIZE * FX_TEXTURE_SIZE];
 #if OPENGL_DEBUG
 	uint		i;
 #endif
 
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
-	gen_fx(texture, verts, indices);
+	// replace the old resources when switching worlds
+	if (r_fx_tex) {
+		glDeleteTextures(1, &r_fx_tex);
+		glDeleteBuffersARB(2, r_fx_VBOs);
+	}
 
 	// generate texture
 	glGenTextures(1, &r_fx_tex);
@@ -27,7 +37,7 @@ void r_create_fx(void) {
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8_ALPHA8,
 				FX_TEXTURE_SIZE, FX_TEXTURE_SIZE, 0,
-				GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, texture);
+				GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, r_fx_texels);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -38,9 +48,9 @@ void r_create_fx(void) {
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, r_fx_VBOs[0]);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, r_fx_VBOs[1]);
 	glBufferDataARB(GL_ARRAY_BUFFER_ARB,
-		sizeof(verts), verts, GL_STATIC_DRAW_ARB);
+		sizeof(r_fx_verts), r_fx_verts, GL_STATIC_DRAW_ARB);
 	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,
-		sizeof(indices), indices, GL_STATIC_DRAW_ARB);
+		sizeof(r_fx_indices), r_fx_indices, GL_STATIC_DRAW_ARB);
 	// unbind VBOs
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
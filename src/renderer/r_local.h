@@ -45,6 +45,11 @@ typedef enum {
 /// Performs frustum culling on the given AABB (axis-aligned bounding box).
 /// \return			see \ref cullResult_t
 cullResult_t r_cull_bbox(ac_vec4_t bounds[2]);
+/// Performs frustum culling on 4 AABBs at once.
+/// \param bounds	the boxes to cull
+/// \param result	array to store the result for every box in, the same as
+///					\ref r_cull_bbox would return
+void r_cull_bbox4(const ac_box4_t *bounds, cullResult_t result[4]);
 /// Performs frustum culling on the given sphere.
 /// \return			true if sphere outside the view frustum, false if inside or
 ///					intersecting
@@ -66,7 +71,9 @@ void r_draw_terrain(void);
 void r_destroy_terrain(void);
 
 // prop drawing engine
-/// Creates all prop resources.
+/// Generates the prop geometry and texture; doesn't touch OpenGL.
+void r_generate_props(void);
+/// Uploads the prop resources made by \ref r_generate_props.
 void r_create_props(void);
 /// Draws all props.
 void r_draw_props(void);
@@ -74,7 +81,9 @@ void r_draw_props(void);
 void r_destroy_props(void);
 
 // FX engine
-/// Creates all special effects resources.
+/// Generates the special effects geometry and texture; doesn't touch OpenGL.
+void r_generate_fx(void);
+/// Uploads the special effects resources made by \ref r_generate_fx.
 void r_create_fx(void);
 /// Frees all special effects resources.
 void r_destroy_fx(void);
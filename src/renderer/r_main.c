@@ -187,6 +187,42 @@ cullResult_t r_cull_bbox(ac_vec4_t bounds[2]) {
 	return intersect ? CR_INTERSECT : CR_INSIDE;
 }
 
+void r_cull_bbox4(const ac_box4_t *bounds, cullResult_t result[4]) {
+	__m128 d, n, p, outside, intersect;
+	int i, j, outMask, isectMask;
+
+	outside = _mm_setzero_ps();
+	intersect = _mm_setzero_ps();
+	for (i = 0; i < 6; i++) {
+		// pick the far points of the boxes along the plane normal; the dot
+		// products are summed in the same order as in ac_vec_dot
+		n = _mm_setzero_ps();
+		p = _mm_setzero_ps();
+		for (j = 0; j < 3; j++) {
+			d = _mm_set1_ps(r_frustum[i].f[j]);
+			if (signbit(r_frustum[i].f[j])) {
+				n = _mm_add_ps(n, _mm_mul_ps(bounds->mins[j].sse, d));
+				p = _mm_add_ps(p, _mm_mul_ps(bounds->maxs[j].sse, d));
+			} else {
+				n = _mm_add_ps(n, _mm_mul_ps(bounds->maxs[j].sse, d));
+				p = _mm_add_ps(p, _mm_mul_ps(bounds->mins[j].sse, d));
+			}
+		}
+		d = _mm_set1_ps(r_frustum[i].f[3]);
+		// negative far point behind plane -> box outside frustum
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(n, d));
+		intersect = _mm_or_ps(intersect, _mm_cmplt_ps(p, d));
+	}
+	outMask = _mm_movemask_ps(outside);
+	isectMask = _mm_movemask_ps(intersect);
+	for (i = 0; i < 4; i++) {
+		if (outMask & (1 << i))
+			result[i] = CR_OUTSIDE;
+		else
+			result[i] = isectMask & (1 << i) ? CR_INTERSECT : CR_INSIDE;
+	}
+}
+
 static bool r_init_FBO(void) {
 	size_t i;
 	GLenum status;
@@ -437,10 +473,9 @@ bool r_init(uint *vcounter, uint *tcounter,
 	if (!r_create_shaders())
 		return false;
 
-	// generate resources
+	// generate resources; the generated ones are uploaded by
+	// r_upload_resources once they're ready
 	r_create_terrain();
-	r_create_props();
-	r_create_fx();
 	r_create_font();
 	r_create_footmobile();
 
@@ -449,6 +484,20 @@ bool r_init(uint *vcounter, uint *tcounter,
 	return true;
 }
 
+void r_generate_resources(void) {
+	r_generate_props();
+	r_generate_fx();
+}
+
+void r_upload_resources(void) {
+	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
+
+	r_create_props();
+	r_create_fx();
+
+	OPENGL_EVENT_END();
+}
+
 void r_shutdown(void) {
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
@@ -10,25 +10,35 @@
 uint		r_prop_tex;
 uint		r_prop_VBOs[2];
 
+// CPU-side prop resources, made by r_generate_props
+static ac_vertex_t	r_prop_verts[TREE_BASE + 1		// LOD 0
+						+ TREE_BASE - 2		// LOD 1
+						+ TREE_BASE - 4		// LOD 2
+						+ BLDG_FLAT_VERTS
+						+ BLDG_SLNT_VERTS];
+static uchar		r_prop_indices[TREE_BASE + 2		// LOD 0
+						+ TREE_BASE			// LOD 1
+						+ TREE_BASE - 2		// LOD 2
+						+ BLDG_FLAT_INDICES
+						+ BLDG_SLNT_INDICES];
+static uchar		r_prop_texels[PROP_TEXTURE_SIZE * PROP_TEXTURE_SIZE];
+
+void r_generate_props(void) {
+	gen_props(r_prop_texels, r_prop_verts, r_prop_indices);
+}
+
 void r_create_props(void) {
-	ac_vertex_t	verts[TREE_BASE + 1		// LOD 0
-					+ TREE_BASE - 2		// LOD 1
-					+ TREE_BASE - 4		// LOD 2
-					+ BLDG_FLAT_VERTS
-					+ BLDG_SLNT_VERTS];
-	uchar		indices[TREE_BASE + 2		// LOD 0
-					+ TREE_BASE			// LOD 1
-					+ TREE_BASE - 2		// LOD 2
-					+ BLDG_FLAT_INDICES
-					+ BLDG_SLNT_INDICES];
-	uchar		texture[PROP_TEXTURE_SIZE * PROP_TEXTURE_SIZE];
 #if OPENGL_DEBUG
 	uint		i;
 #endif
 
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
-	gen_props(texture, verts, indices);
+	// the prop texture depends on the world, so replace the old one
+	if (r_prop_tex) {
+		glDeleteTextures(1, &r_prop_tex);
+		glDeleteBuffersARB(2, r_prop_VBOs);
+	}
 
 	// generate texture
 	glGenTextures(1, &r_prop_tex);
@@ -36,7 +46,7 @@ void r_create_props(void) {
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8,
 				PROP_TEXTURE_SIZE, PROP_TEXTURE_SIZE, 0,
-				GL_LUMINANCE, GL_UNSIGNED_BYTE, texture);
+				GL_LUMINANCE, GL_UNSIGNED_BYTE, r_prop_texels);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -47,9 +57,9 @@ void r_create_props(void) {
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, r_prop_VBOs[0]);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, r_prop_VBOs[1]);
 	glBufferDataARB(GL_ARRAY_BUFFER_ARB,
-		sizeof(verts), verts, GL_STATIC_DRAW_ARB);
+		sizeof(r_prop_verts), r_prop_verts, GL_STATIC_DRAW_ARB);
 	glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,
-		sizeof(indices), indices, GL_STATIC_DRAW_ARB);
+		sizeof(r_prop_indices), r_prop_indices, GL_STATIC_DRAW_ARB);
 	// unbind VBOs
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
@@ -65,17 +75,22 @@ void r_create_props(void) {
 	OPENGL_EVENT_END();
 }
 
-static void r_recurse_proptree_drawall(ac_prop_t *node) {
+static void r_recurse_proptree_drawall(const ac_prop_t *node,
+	int x, int y, int size) {
+	const ac_prop_t *c;
+	int q;
+
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
-	if (node->trees) {
+	if (node->type == PROP_TREES) {
 		int i;
 		float d2;
 		ac_tree_t *t;
 		long ofs, num;
+		ac_vec4_t l, bounds[2];
 		// pick level of detail
-		ac_vec4_t l = ac_vec_mulf(
-			ac_vec_add(node->bounds[0], node->bounds[1]), 0.5);
+		gen_prop_bounds(node, x, y, size, bounds);
+		l = ac_vec_mulf(ac_vec_add(bounds[0], bounds[1]), 0.5);
 		l = ac_vec_sub(l, r_viewpoint);
 		d2 = ac_vec_dot(l, l);
 
@@ -90,7 +105,8 @@ static void r_recurse_proptree_drawall(ac_prop_t *node) {
 			num = TREE_BASE - 2;
 		}
 
-		for (t = node->trees, i = 0; i < TREES_PER_FIELD; i++, t++) {
+		for (t = gen_trees + node->first, i = 0; i < node->count;
+			i++, t++) {
 			OPENGL_EVENT_BEGIN(0, "Draw tree");
 
 			glMultiTexCoord3fv(GL_TEXTURE1, t->pos.f);
@@ -107,10 +123,11 @@ static void r_recurse_proptree_drawall(ac_prop_t *node) {
 		OPENGL_EVENT_END();
 
 		return;
-	} else if (node->bldgs) {
+	} else if (node->type == PROP_BLDGS) {
 		int i;
 		ac_bldg_t *b;
-		for (b = node->bldgs, i = 0; i < BLDGS_PER_FIELD; i++, b++) {
+		for (b = gen_bldgs + node->first, i = 0; i < node->count;
+			i++, b++) {
 			OPENGL_EVENT_BEGIN(0, "Draw building");
 
 			glMultiTexCoord3fv(GL_TEXTURE1, b->pos.f);
@@ -141,45 +158,57 @@ static void r_recurse_proptree_drawall(ac_prop_t *node) {
 
 		return;
 	}
-	if (node->child[0])
-		r_recurse_proptree_drawall(node->child[0]);
-	if (node->child[1])
-		r_recurse_proptree_drawall(node->child[1]);
-	if (node->child[2])
-		r_recurse_proptree_drawall(node->child[2]);
-	if (node->child[3])
-		r_recurse_proptree_drawall(node->child[3]);
+	// the children are stored next to each other, in quadrant order
+	c = gen_proptree + node->first;
+	size >>= 1;
+	for (q = 0; q < 4; q++) {
+		if (node->children & (1 << q))
+			r_recurse_proptree_drawall(c++,
+				x + (q & 1) * size, y + (q >> 1) * size, size);
+	}
 
 	OPENGL_EVENT_END();
 }
 
-static void r_recurse_proptree(ac_prop_t *node, int step) {
+/// \brief Draws the visible props of a prop tree node.
+/// The children of a node are culled all at once, before descending into them.
+/// \param cull		culling result of the node itself
+static void r_recurse_proptree(const ac_prop_t *node, int x, int y, int size,
+								cullResult_t cull) {
+	const ac_prop_t *c;
+	ac_box4_t bounds;
+	cullResult_t childCull[4];
+	int q;
+
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
-	switch (r_cull_bbox(node->bounds)) {
+	switch (cull) {
 		case CR_OUTSIDE:
 			OPENGL_EVENT_END();
 			return;
 		case CR_INSIDE:
-			if (node)
-				r_recurse_proptree_drawall(node);
+			r_recurse_proptree_drawall(node, x, y, size);
 			break;
 		case CR_INTERSECT:
-			if ((step >>= 1) < 2 && node) {
-				r_recurse_proptree_drawall(node);
+			// not worth culling any further
+			if (size < 8 || node->type != PROP_BRANCH) {
+				r_recurse_proptree_drawall(node, x, y, size);
 
 				OPENGL_EVENT_END();
 
 				return;
 			}
-			if (node->child[0])
-				r_recurse_proptree(node->child[0], step);
-			if (node->child[1])
-				r_recurse_proptree(node->child[1], step);
-			if (node->child[2])
-				r_recurse_proptree(node->child[2], step);
-			if (node->child[3])
-				r_recurse_proptree(node->child[3], step);
+			// all the children are in the same cache line or two
+			gen_prop_child_bounds(node, x, y, size, &bounds);
+			r_cull_bbox4(&bounds, childCull);
+			c = gen_proptree + node->first;
+			size >>= 1;
+			for (q = 0; q < 4; q++) {
+				if (node->children & (1 << q))
+					r_recurse_proptree(c++,
+						x + (q & 1) * size, y + (q >> 1) * size, size,
+						childCull[q]);
+			}
 			break;
 	}
 
@@ -187,6 +216,8 @@ static void r_recurse_proptree(ac_prop_t *node, int step) {
 }
 
 void r_draw_props(void) {
+	ac_vec4_t bounds[2];
+
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
 	// make the necessary state changes
@@ -199,7 +230,11 @@ void r_draw_props(void) {
 					(void *)offsetof(ac_vertex_t, st[0]));
 	glUseProgramObjectARB(r_prop_prog);
 
-	r_recurse_proptree(gen_proptree, PROPMAP_SIZE / 2);
+	if (gen_proptree) {
+		gen_prop_bounds(gen_proptree, 0, 0, PROPMAP_SIZE, bounds);
+		r_recurse_proptree(gen_proptree, 0, 0, PROPMAP_SIZE,
+			r_cull_bbox(bounds));
+	}
 
 	// bring the previous state back
 	glUseProgramObjectARB(0);
@@ -213,7 +248,7 @@ void r_draw_props(void) {
 void r_destroy_props(void) {
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
-	gen_free_proptree(NULL);
+	gen_free_proptree();
 	glDeleteTextures(1, &r_prop_tex);
 	glDeleteBuffersARB(2, r_prop_VBOs);
 
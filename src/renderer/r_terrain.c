@@ -30,12 +30,21 @@
 // geometry every time
 //#define MAP_VBO
 
+/// maximum number of heightmap mip levels
+#define MAX_HEIGHT_MIPS				16
+
 // resources
 GLuint		r_hmap_tex;
 int			r_ter_max_levels;
 ac_vertex_t	r_ter_verts[TERRAIN_NUM_VERTS];
 uint		r_ter_VBOs[2];
 
+// heightmap mip chain; level i is downsampled by 2^i and NULL for the levels
+// sampled straight from the heightmap (see r_sample_height)
+static uchar	*r_hmips[MAX_HEIGHT_MIPS];
+static uchar	*r_hmip_data;
+static int		r_num_hmips;
+
 static void r_fill_terrain_indices(ushort *indices) {
 	short	i, j;	// must be signed
 	ushort	*p = indices;
@@ -173,26 +182,120 @@ void r_create_terrain(void) {
 	OPENGL_EVENT_END();
 }
 
+/// \brief Filters a rectangle of a height mip level out of the level above it.
+/// Every texel is the average of a 2x2 block of the previous level.
+/// \param src		previous level
+/// \param x0, y0	first texel of the rectangle
+/// \param x1, y1	last texel of the rectangle (inclusive)
+static void r_filter_height_mip(int level, const uchar *src,
+								int x0, int y0, int x1, int y1) {
+	const int side = HEIGHTMAP_SIZE >> level;
+	const uchar *a, *b;
+	uchar *dst;
+	int x, y;
+
+	for (y = y0; y <= y1; y++) {
+		a = src + y * 2 * side * 2 + x0 * 2;
+		b = a + side * 2;
+		dst = r_hmips[level] + y * side + x0;
+		for (x = x0; x <= x1; x++, a += 2, b += 2, dst++)
+			*dst = (a[0] + a[1] + b[0] + b[1] + 2) >> 2;
+	}
+}
+
+/// Builds the box-filtered mip chain of the heightmap for the coarse patches.
+static void r_build_height_mips(const uchar *texels, int size) {
+	const uchar *src;
+	uchar *dst;
+	size_t total = 0;
+	int level, first, side;
+
+	free(r_hmip_data);
+	r_hmip_data = NULL;
+	memset(r_hmips, 0, sizeof(r_hmips));
+
+	// the texture is either the heightmap or the overview map of a streamed
+	// one, and the levels up to its own are sampled straight from the
+	// heightmap; there's no use for levels coarser than the sample spacing of
+	// the root patch, either
+	for (first = 0; HEIGHTMAP_SIZE >> first > size; first++);
+	for (level = first + 1, side = size >> 1;
+		level < MAX_HEIGHT_MIPS && side >= TERRAIN_PATCH_SIZE - 1;
+		level++, side >>= 1)
+		total += side * side;
+	r_num_hmips = level;
+	if (!total)
+		return;
+	r_hmip_data = malloc(total);
+
+	src = texels;
+	dst = r_hmip_data;
+	for (level = first + 1; level < r_num_hmips; level++) {
+		side = HEIGHTMAP_SIZE >> level;
+		r_hmips[level] = dst;
+		r_filter_height_mip(level, src, 0, 0, side - 1, side - 1);
+		src = dst;
+		dst += side * side;
+	}
+}
+
+/// \brief Uploads the regions of the heightmap changed since the last frame.
+/// Only the changed texels of the texture and the mip chain are updated, so
+/// a crater costs about as much as it is large. The texture must be bound.
+static void r_update_heightmap(void) {
+	const uchar *src;
+	int rect[4], level;
+
+	while (gen_next_dirty_rect(rect)) {
+		// streamed heightmaps are never changed, so this is always the
+		// heightmap in its entirety
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, HEIGHTMAP_SIZE);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect[0], rect[1],
+			rect[2] - rect[0] + 1, rect[3] - rect[1] + 1,
+			GL_LUMINANCE, GL_UNSIGNED_BYTE,
+			gen_heightmap + rect[1] * HEIGHTMAP_SIZE + rect[0]);
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		src = gen_heightmap;
+		for (level = 1; level < r_num_hmips && r_hmips[level]; level++) {
+			rect[0] >>= 1;
+			rect[1] >>= 1;
+			rect[2] >>= 1;
+			rect[3] >>= 1;
+			r_filter_height_mip(level, src, rect[0], rect[1], rect[2],
+				rect[3]);
+			src = r_hmips[level];
+		}
+	}
+}
+
 void r_set_heightmap(void) {
 #if OPENGL_DEBUG
 	uint		i;
 #endif
+	// streamed heightmaps only upload their overview map
+	int			size;
+	const uchar	*texels = gen_terrain_texture(&size);
 
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
-	if (gen_heightmap != NULL)
+	if (r_hmap_tex)
 		glDeleteTextures(1, &r_hmap_tex);
 	glGenTextures(1, &r_hmap_tex);
 	glBindTexture(GL_TEXTURE_2D, r_hmap_tex);
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE8,
-				HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, 0,
-				GL_LUMINANCE, GL_UNSIGNED_BYTE, gen_heightmap);
+				size, size, 0,
+				GL_LUMINANCE, GL_UNSIGNED_BYTE, texels);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
+	r_build_height_mips(texels, size);
+
 #if OPENGL_DEBUG
 	if (GLEW_KHR_debug) {
 		glObjectLabel(GL_TEXTURE, r_hmap_tex, -1, "Heightmap");
@@ -207,12 +310,32 @@ void r_set_heightmap(void) {
 void r_destroy_terrain(void) {
 	glDeleteTextures(1, &r_hmap_tex);
 	glDeleteBuffersARB(2, r_ter_VBOs);
+	free(r_hmip_data);
+	r_hmip_data = NULL;
+	memset(r_hmips, 0, sizeof(r_hmips));
+	r_num_hmips = 0;
 }
 
-static inline float r_sample_height(float s, float t) {
-	int x = roundf(s * (HEIGHTMAP_SIZE - 1));
-	int y = roundf(t * (HEIGHTMAP_SIZE - 1));
-	return (float)gen_heightmap[y * HEIGHTMAP_SIZE + x];
+static inline float r_sample_height(float s, float t, int level) {
+	int x, y, side;
+	float inv;
+
+	if (level >= r_num_hmips)
+		level = r_num_hmips - 1;
+	if (level < 1 || !r_hmips[level]) {
+		x = roundf(s * (HEIGHTMAP_SIZE - 1));
+		y = roundf(t * (HEIGHTMAP_SIZE - 1));
+		return (float)gen_height_approx(x, y);
+	}
+
+	// mip texels stand for the centres of the blocks they average
+	side = HEIGHTMAP_SIZE >> level;
+	inv = 1.f / (float)(1 << level);
+	x = roundf(s * (HEIGHTMAP_SIZE - 1) * inv - 0.5f + 0.5f * inv);
+	y = roundf(t * (HEIGHTMAP_SIZE - 1) * inv - 0.5f + 0.5f * inv);
+	x = x < 0 ? 0 : (x >= side ? side - 1 : x);
+	y = y < 0 ? 0 : (y >= side ? side - 1 : y);
+	return (float)r_hmips[level][y * side + x];
 }
 
 #if !defined(UNIFORM_HEIGHTS) && defined(MAP_VBO)
@@ -222,7 +345,7 @@ static inline float r_sample_height(float s, float t) {
 #define RW_TERRAIN_VBO
 #endif
 static void r_terrain_patch(float bu, float bv, float scale) {
-	int i, j;
+	int i, j, level;
 #if defined(UNIFORM_HEIGHTS) || (defined(MAP_VBO) && defined(RW_TERRAIN_VBO))
 	float s, t;
 	static const float invScaleX = 1.f / (TERRAIN_PATCH_SIZE - 1.f);
@@ -236,13 +359,20 @@ static void r_terrain_patch(float bu, float bv, float scale) {
 
 	OPENGL_EVENT_BEGIN(0, __PRETTY_FUNCTION__);
 
+	// sample the mip level whose texels are as far apart as the patch's
+	// vertices, so that they're all read from a small, contiguous area
+	level = roundf(log2f(scale * (HEIGHTMAP_SIZE - 1)
+		/ (TERRAIN_PATCH_SIZE - 1.f)));
+	if (level < 0)
+		level = 0;
+
 #ifdef UNIFORM_HEIGHTS
 	for (i = 0; i < TERRAIN_PATCH_SIZE; i++) {
 		t = /*(1.f - */i * invScaleY/*)*/ * scale;
 		for (j = 0; j < TERRAIN_PATCH_SIZE; j++) {
 			s = j * invScaleX * scale;
 			heights[i * TERRAIN_PATCH_SIZE + j] = r_sample_height(bu + s,
-																bv + t);
+																bv + t, level);
 		}
 	}
 	glUniform4fvARB(r_ter_height_samples,
@@ -268,11 +398,12 @@ static void r_terrain_patch(float bu, float bv, float scale) {
 			v->pos.f[1] = r_sample_height(
 #ifdef RW_TERRAIN_VBO
 				bu + v->st[0] * scale,
-				bv + v->st[1] * scale
+				bv + v->st[1] * scale,
 #else
 				bu + s * scale,
-				bv + t * scale
+				bv + t * scale,
 #endif
+				level
 			);
 		}
 	}
@@ -283,7 +414,8 @@ static void r_terrain_patch(float bu, float bv, float scale) {
 		for (j = 0; j < TERRAIN_PATCH_SIZE; j++, v++) {
 			v->pos.f[1] = r_sample_height(
 				bu + v->st[0] * scale,
-				bv + v->st[1] * scale
+				bv + v->st[1] * scale,
+				level
 			);
 		}
 	}
@@ -312,14 +444,20 @@ static void r_recurse_terrain(float minU, float minV,
 	ac_vec4_t v, bounds[2];
 	float halfU = (minU + maxU) * 0.5;
 	float halfV = (minV + maxV) * 0.5;
-
-	// apply frustum culling
+	uchar range[2];
+
+	// apply frustum culling; the skirts hanging below the patch are left out,
+	// they only fill the cracks between visible patches anyway
+	gen_height_range(floorf(minU * (HEIGHTMAP_SIZE - 1)),
+		floorf(minV * (HEIGHTMAP_SIZE - 1)),
+		ceilf(maxU * (HEIGHTMAP_SIZE - 1)),
+		ceilf(maxV * (HEIGHTMAP_SIZE - 1)), range);
 	bounds[0] = ac_vec_set((minU - 0.5) * HEIGHTMAP_SIZE,
-					-10.f,
+					range[0] * HEIGHT_SCALE,
 					(minV - 0.5) * HEIGHTMAP_SIZE,
 					0.f);
 	bounds[1] = ac_vec_set((maxU - 0.5) * HEIGHTMAP_SIZE,
-					HEIGHT,
+					range[1] * HEIGHT_SCALE,
 					(maxV - 0.5) * HEIGHTMAP_SIZE,
 					0.f);
 	if (r_cull_bbox(bounds) == CR_OUTSIDE) {
@@ -362,6 +500,7 @@ void r_draw_terrain(void) {
 	glBindBufferARB(GL_ARRAY_BUFFER_ARB, r_ter_VBOs[0]);
 	glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, r_ter_VBOs[1]);
 	glBindTexture(GL_TEXTURE_2D, r_hmap_tex);
+	r_update_heightmap();
 
 	// traverse the quadtree
 	r_recurse_terrain(0.f, 0.f, 1.f, 1.f,
@@ -0,0 +1,547 @@
+// AC-130 shooter
+// Written by Leszek Godlewski <leszgod081@student.polsl.pl>
+
+// Headless generator benchmark; times the generator stages over a range of
+// seeds, world sizes and worker thread counts, and hashes their results to
+// catch determinism regressions
+
+#include <stdio.h>
+#include <string.h>
+#include "../ac130.h"
+#include "../ac_jobs.h"
+#ifdef WIN32
+	#define WIN32_LEAN_AND_MEAN
+	// GetProcessMemoryInfo from kernel32, no need for psapi.lib
+	#define PSAPI_VERSION	2
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+/// Maximum number of entries of the list options (-s, -j).
+#define BENCH_MAX_LIST		16
+
+/// Timed stages, in the order the game runs them in.
+typedef enum {
+	STAGE_OPEN,
+	STAGE_PROPS,
+	STAGE_FX,
+	STAGE_TERRAIN,
+	STAGE_PROPLISTS,
+	STAGE_SAVE,
+	NUM_STAGES
+} bench_stage_t;
+
+/// First of the stages whose results are hashed.
+#define FIRST_HASH			STAGE_PROPS
+/// Number of stages whose results are hashed (all but \ref STAGE_OPEN and
+/// \ref STAGE_SAVE).
+#define NUM_HASHES			(STAGE_SAVE - FIRST_HASH)
+
+static const char *bench_stage_names[NUM_STAGES] = {
+	"open",
+	"props",
+	"fx",
+	"terrain",
+	"proplists",
+	"save"
+};
+
+/// Results of a single world generation.
+typedef struct {
+	int		size;				///< \ref HEIGHTMAP_SIZE
+	uint	seed;
+	int		legacy;				///< 1 if the legacy generator was used
+	int		threads;			///< number of worker threads
+	int		run;				///< repetition number
+	double	ms[NUM_STAGES];		///< wall clock time of every stage
+	Uint64	hash[NUM_STAGES];	///< hash of the results of every stage
+	int		numTrees;
+	int		numBldgs;
+	long	scratchKB;			///< peak size of the generator scratch memory
+	long	maxRssKB;			///< peak resident set size of the process
+} bench_result_t;
+
+static int bench_sizes[BENCH_MAX_LIST] = {DEFAULT_HEIGHTMAP_SIZE};
+static int bench_num_sizes = 1;
+static int bench_threads[BENCH_MAX_LIST] = {-1};
+static int bench_num_threads = 1;
+static uint bench_seed = 0xDEADBEEF;
+static int bench_num_seeds = 1;
+static int bench_runs = 1;
+static bool bench_legacy = false;
+static bool bench_cache = false;
+static const char *bench_out_name = NULL;
+static const char *bench_ref_name = NULL;
+
+/// All the results so far, for the comparisons.
+static bench_result_t *bench_results = NULL;
+static int bench_num_results = 0;
+/// Results of a previous run to compare against (-ref).
+static bench_result_t *bench_refs = NULL;
+static int bench_num_refs = 0;
+
+void g_loading_tick(void) {
+	// placeholder for the program to link properly
+}
+
+/// FNV-1a hash of a memory block, continuing from the given hash value.
+static Uint64 bench_hash(Uint64 h, const void *data, size_t size) {
+	const uchar *p = data;
+
+	while (size--) {
+		h ^= *p++;
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+/// FNV-1a offset basis.
+#define BENCH_HASH_INIT		0xCBF29CE484222325ULL
+
+// the structures are hashed field by field, as their padding is undefined
+
+static Uint64 bench_hash_verts(Uint64 h, const ac_vertex_t *v, int count) {
+	for (; count > 0; count--, v++) {
+		h = bench_hash(h, v->pos.f, sizeof(v->pos.f));
+		h = bench_hash(h, v->st, sizeof(v->st));
+		h = bench_hash(h, &v->index, sizeof(v->index));
+	}
+	return h;
+}
+
+static Uint64 bench_hash_trees(Uint64 h, const ac_tree_t *t, int count) {
+	for (; count > 0; count--, t++) {
+		h = bench_hash(h, t->pos.f, sizeof(t->pos.f));
+		h = bench_hash(h, &t->ang, sizeof(t->ang));
+		h = bench_hash(h, &t->XZscale, sizeof(t->XZscale));
+		h = bench_hash(h, &t->Yscale, sizeof(t->Yscale));
+	}
+	return h;
+}
+
+static Uint64 bench_hash_bldgs(Uint64 h, const ac_bldg_t *b, int count) {
+	for (; count > 0; count--, b++) {
+		h = bench_hash(h, b->pos.f, sizeof(b->pos.f));
+		h = bench_hash(h, &b->ang, sizeof(b->ang));
+		h = bench_hash(h, &b->Xscale, sizeof(b->Xscale));
+		h = bench_hash(h, &b->Yscale, sizeof(b->Yscale));
+		h = bench_hash(h, &b->Zscale, sizeof(b->Zscale));
+		h = bench_hash(h, &b->slantedRoof, sizeof(b->slantedRoof));
+	}
+	return h;
+}
+
+/// Hashes the subtree of the given prop tree node, depth first.
+static Uint64 bench_hash_proptree(Uint64 h, const ac_prop_t *n) {
+	const ac_prop_t *child;
+	int i;
+
+	h = bench_hash(h, n->bounds, sizeof(n->bounds));
+	h = bench_hash(h, &n->first, sizeof(n->first));
+	h = bench_hash(h, &n->children, sizeof(n->children));
+	h = bench_hash(h, &n->type, sizeof(n->type));
+	h = bench_hash(h, &n->count, sizeof(n->count));
+	if (n->type != PROP_BRANCH)
+		return h;
+	child = gen_proptree + n->first;
+	for (i = 0; i < 4; i++) {
+		if (n->children & (1 << i))
+			h = bench_hash_proptree(h, child++);
+	}
+	return h;
+}
+
+/// Returns the number of milliseconds elapsed since the given counter value.
+static double bench_ms(Uint64 start) {
+	return (double)(SDL_GetPerformanceCounter() - start) * 1000.0
+		/ (double)SDL_GetPerformanceFrequency();
+}
+
+/// Returns the peak resident set size of the process in kilobytes.
+static long bench_max_rss(void) {
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return (long)(pmc.PeakWorkingSetSize >> 10);
+#else
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		return 0;
+#ifdef __APPLE__
+	// reported in bytes rather than kilobytes
+	return ru.ru_maxrss >> 10;
+#else
+	return ru.ru_maxrss;
+#endif
+#endif
+}
+
+/// Generates a world the way the game does, timing and hashing every stage.
+static void bench_world(bench_result_t *r, ac_tree_t *trees, ac_bldg_t *bldgs) {
+	static uchar propTex[PROP_TEXTURE_SIZE * PROP_TEXTURE_SIZE];
+	static ac_vertex_t propVerts[TREE_BASE * 3 - 5
+		+ BLDG_FLAT_VERTS + BLDG_SLNT_VERTS];
+	static uchar propIndices[TREE_BASE * 3
+		+ BLDG_FLAT_INDICES + BLDG_SLNT_INDICES];
+	// static, so that the fields the generator leaves alone (e.g. the vertex
+	// indices) are always zeros
+	static uchar fxTex[2 * FX_TEXTURE_SIZE * FX_TEXTURE_SIZE];
+	static ac_vertex_t fxVerts[4];
+	static uchar fxIndices[4];
+	const uchar *tex;
+	Uint64 start, h;
+	int texSize;
+
+	// includes mapping and validating the cache file, if there is one
+	start = SDL_GetPerformanceCounter();
+	gen_open_world(r->seed);
+	r->ms[STAGE_OPEN] = bench_ms(start);
+
+	start = SDL_GetPerformanceCounter();
+	gen_props(propTex, propVerts, propIndices);
+	r->ms[STAGE_PROPS] = bench_ms(start);
+	h = bench_hash(BENCH_HASH_INIT, propTex, sizeof(propTex));
+	h = bench_hash_verts(h, propVerts, sizeof(propVerts) / sizeof(*propVerts));
+	r->hash[STAGE_PROPS] = bench_hash(h, propIndices, sizeof(propIndices));
+
+	start = SDL_GetPerformanceCounter();
+	gen_fx(fxTex, fxVerts, fxIndices);
+	r->ms[STAGE_FX] = bench_ms(start);
+	h = bench_hash(BENCH_HASH_INIT, fxTex, sizeof(fxTex));
+	h = bench_hash_verts(h, fxVerts, sizeof(fxVerts) / sizeof(*fxVerts));
+	r->hash[STAGE_FX] = bench_hash(h, fxIndices, sizeof(fxIndices));
+
+	start = SDL_GetPerformanceCounter();
+	gen_terrain(r->seed);
+	r->ms[STAGE_TERRAIN] = bench_ms(start);
+	// a streamed heightmap is never resident, so its overview map is hashed
+	// instead
+	tex = gen_terrain_texture(&texSize);
+	r->hash[STAGE_TERRAIN] = bench_hash(BENCH_HASH_INIT, tex,
+		(size_t)texSize * texSize);
+
+	start = SDL_GetPerformanceCounter();
+	gen_proplists(&r->numTrees, trees, &r->numBldgs, bldgs);
+	r->ms[STAGE_PROPLISTS] = bench_ms(start);
+	h = bench_hash_trees(BENCH_HASH_INIT, trees, r->numTrees);
+	h = bench_hash_bldgs(h, bldgs, r->numBldgs);
+	r->hash[STAGE_PROPLISTS] = gen_proptree
+		? bench_hash_proptree(h, gen_proptree) : h;
+
+	start = SDL_GetPerformanceCounter();
+	gen_save_world();
+	r->ms[STAGE_SAVE] = bench_ms(start);
+	r->scratchKB = (long)(gen_scratch_peak() >> 10);
+	r->maxRssKB = bench_max_rss();
+
+	gen_free_proptree();
+	gen_free_terrain();
+}
+
+/// \brief Compares the hashes of two results of the same world.
+/// \return				false if any of them differ, after reporting them
+static bool bench_compare(const bench_result_t *r, const bench_result_t *ref,
+						const char *what) {
+	bool same = true;
+	int i;
+
+	for (i = FIRST_HASH; i < FIRST_HASH + NUM_HASHES; i++) {
+		if (r->hash[i] == ref->hash[i])
+			continue;
+		fprintf(stderr, "Determinism failure: %s of seed 0x%X, size %d, "
+			"%d threads, run %d differ from %s\n", bench_stage_names[i],
+			r->seed, r->size, r->threads, r->run, what);
+		same = false;
+	}
+	return same;
+}
+
+/// \brief Compares a result to those of the same world so far and in the
+/// reference file.
+/// \return				false on any mismatch
+static bool bench_check(const bench_result_t *r) {
+	const bench_result_t *o;
+	int i;
+
+	// the first of the earlier results of the same world is enough, as every
+	// one of them has already been compared to it
+	for (i = 0; i < bench_num_results; i++) {
+		o = &bench_results[i];
+		if (o->size == r->size && o->seed == r->seed
+			&& o->legacy == r->legacy)
+			return bench_compare(r, o, "the first run");
+	}
+	for (i = 0; i < bench_num_refs; i++) {
+		o = &bench_refs[i];
+		if (o->size == r->size && o->seed == r->seed
+			&& o->legacy == r->legacy)
+			return bench_compare(r, o, "the reference");
+	}
+	return true;
+}
+
+static void bench_print_header(FILE *f) {
+	int i;
+
+	fprintf(f, "size,seed,legacy,threads,run");
+	for (i = 0; i < NUM_STAGES; i++)
+		fprintf(f, ",%s_ms", bench_stage_names[i]);
+	fprintf(f, ",total_ms");
+	for (i = FIRST_HASH; i < FIRST_HASH + NUM_HASHES; i++)
+		fprintf(f, ",%s_hash", bench_stage_names[i]);
+	fprintf(f, ",trees,bldgs,scratch_kb,maxrss_kb\n");
+}
+
+static void bench_print_result(FILE *f, const bench_result_t *r) {
+	double total = 0.0;
+	int i;
+
+	fprintf(f, "%d,0x%08X,%d,%d,%d", r->size, r->seed, r->legacy, r->threads,
+		r->run);
+	for (i = 0; i < NUM_STAGES; i++) {
+		fprintf(f, ",%.3f", r->ms[i]);
+		total += r->ms[i];
+	}
+	fprintf(f, ",%.3f", total);
+	for (i = FIRST_HASH; i < FIRST_HASH + NUM_HASHES; i++)
+		fprintf(f, ",%016llX", (unsigned long long)r->hash[i]);
+	fprintf(f, ",%d,%d,%ld,%ld\n", r->numTrees, r->numBldgs, r->scratchKB,
+		r->maxRssKB);
+	fflush(f);
+}
+
+/// \brief Parses a line of the output of a previous run.
+/// \return				false if the line is not a result (e.g. the header)
+static bool bench_parse_result(const char *line, bench_result_t *r) {
+	unsigned long long hash[NUM_HASHES];
+	const char *p;
+	int i;
+
+	memset(r, 0, sizeof(*r));
+	if (sscanf(line, "%d,%x,%d,%d,%d", &r->size, &r->seed, &r->legacy,
+		&r->threads, &r->run) != 5)
+		return false;
+	// skip the 5 fields above and the timings
+	for (p = line, i = 0; p && i < 5 + NUM_STAGES + 1; i++) {
+		if ((p = strchr(p, ',')) != NULL)
+			p++;
+	}
+	if (!p || sscanf(p, "%llx,%llx,%llx,%llx,%d,%d", &hash[0], &hash[1],
+		&hash[2], &hash[3], &r->numTrees, &r->numBldgs) != NUM_HASHES + 2)
+		return false;
+	for (i = 0; i < NUM_HASHES; i++)
+		r->hash[FIRST_HASH + i] = hash[i];
+	return true;
+}
+
+/// Loads the results of a previous run to compare against.
+static bool bench_load_refs(const char *name) {
+	char line[512];
+	bench_result_t r, *refs;
+	FILE *f;
+
+	if (!(f = fopen(name, "r")))
+		return false;
+	while (fgets(line, sizeof(line), f)) {
+		if (!bench_parse_result(line, &r))
+			continue;
+		refs = realloc(bench_refs, sizeof(*refs) * (bench_num_refs + 1));
+		if (!refs)
+			break;
+		bench_refs = refs;
+		bench_refs[bench_num_refs++] = r;
+	}
+	fclose(f);
+	return true;
+}
+
+/// \brief Parses a comma-separated list of integers.
+/// \return				number of entries, 0 on error
+static int bench_parse_list(const char *s, int *list) {
+	char *end;
+	int n = 0;
+
+	do {
+		if (n >= BENCH_MAX_LIST)
+			return 0;
+		list[n++] = (int)strtol(s, &end, 0);
+		if (end == s)
+			return 0;
+		s = end + 1;
+	} while (*end == ',');
+	return *end ? 0 : n;
+}
+
+static void bench_usage(const char *exe) {
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -s <size>[,<size>...]    world sizes (default: %d)\n"
+		"  -seed <seed>             first seed (default: 0xDEADBEEF)\n"
+		"  -n <count>               number of consecutive seeds (default: 1)\n"
+		"  -j <threads>[,...]       worker thread counts (default: -1, one "
+			"less than\n"
+		"                           there are CPU cores)\n"
+		"  -runs <count>            repetitions of every world (default: 1)\n"
+		"  -m <megabytes>           terrain memory budget\n"
+		"  -legacy                  use the legacy random number generator, "
+			"which places\n"
+		"                           the same props as older versions did\n"
+		"  -cache                   use the cache files in the working "
+			"directory\n"
+		"  -packcache               pack the cache files\n"
+		"  -o <file>                write the results to a file instead of "
+			"stdout\n"
+		"  -ref <file>              compare the hashes to those of an earlier "
+			"run\n"
+		"The results are written as comma-separated values. The exit code is "
+			"1 if\n"
+		"any of the hashes differ between the runs of the same world or from "
+			"the\n"
+		"reference.\n", exe, DEFAULT_HEIGHTMAP_SIZE);
+}
+
+static bool bench_parse_args(int argc, char *argv[]) {
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+			if (!(bench_num_sizes = bench_parse_list(argv[++i], bench_sizes)))
+				return false;
+			continue;
+		}
+		if (!strcmp(argv[i], "-seed") && i + 1 < argc) {
+			bench_seed = (uint)strtoul(argv[++i], NULL, 0);
+			continue;
+		}
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			bench_num_seeds = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+			if (!(bench_num_threads = bench_parse_list(argv[++i],
+				bench_threads)))
+				return false;
+			continue;
+		}
+		if (!strcmp(argv[i], "-runs") && i + 1 < argc) {
+			bench_runs = atoi(argv[++i]);
+			continue;
+		}
+		if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+			int budget = atoi(argv[++i]);
+			if (budget > 0)
+				gen_set_terrain_budget((size_t)budget << 20);
+			continue;
+		}
+		if (!strcmp(argv[i], "-legacy")) {
+			bench_legacy = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "-cache")) {
+			bench_cache = true;
+			continue;
+		}
+		if (!strcmp(argv[i], "-packcache")) {
+			gen_set_cache_packing(true);
+			continue;
+		}
+		if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+			bench_out_name = argv[++i];
+			continue;
+		}
+		if (!strcmp(argv[i], "-ref") && i + 1 < argc) {
+			bench_ref_name = argv[++i];
+			continue;
+		}
+		return false;
+	}
+	return bench_num_seeds > 0 && bench_runs > 0;
+}
+
+int main(int argc, char *argv[]) {
+	ac_tree_t *trees;
+	ac_bldg_t *bldgs;
+	bench_result_t r, *results;
+	FILE *out = stdout;
+	bool ok = true;
+	int t, s, i, run;
+
+	if (!bench_parse_args(argc, argv)) {
+		bench_usage(argv[0]);
+		return 1;
+	}
+	if (bench_ref_name && !bench_load_refs(bench_ref_name)) {
+		fprintf(stderr, "Unable to read the reference results from %s\n",
+			bench_ref_name);
+		return 1;
+	}
+	if (bench_out_name && !(out = fopen(bench_out_name, "w"))) {
+		fprintf(stderr, "Unable to open %s for writing\n", bench_out_name);
+		return 1;
+	}
+
+	if (!ac_box4_check()) {
+		fprintf(stderr, "The vectorized box trace doesn't match the scalar "
+			"one\n");
+		ok = false;
+	}
+	if (!gen_perlin_check()) {
+		fprintf(stderr, "The vectorized noise kernels don't match the scalar "
+			"one\n");
+		ok = false;
+	}
+
+	gen_set_caching(bench_cache);
+	gen_set_legacy_rng(bench_legacy);
+	bench_print_header(out);
+
+	for (t = 0; t < bench_num_threads; t++) {
+		if (!ac_jobs_init(bench_threads[t]))
+			fprintf(stderr, "Unable to start worker threads, generating "
+				"serially\n");
+		for (s = 0; s < bench_num_sizes; s++) {
+			if (!gen_set_heightmap_size(bench_sizes[s])) {
+				fprintf(stderr, "Invalid world size %d, must be a power of 2 "
+					"between %d and %d\n", bench_sizes[s], MIN_HEIGHTMAP_SIZE,
+					MAX_HEIGHTMAP_SIZE);
+				ok = false;
+				continue;
+			}
+			trees = malloc(sizeof(*trees) * MAX_NUM_TREES);
+			bldgs = malloc(sizeof(*bldgs) * MAX_NUM_BLDGS);
+			for (i = 0; i < bench_num_seeds; i++) {
+				for (run = 0; run < bench_runs; run++) {
+					memset(&r, 0, sizeof(r));
+					r.size = HEIGHTMAP_SIZE;
+					r.seed = bench_seed + i;
+					r.legacy = bench_legacy;
+					r.threads = ac_jobs_num_threads();
+					r.run = run;
+					bench_world(&r, trees, bldgs);
+					bench_print_result(out, &r);
+					ok = bench_check(&r) && ok;
+					results = realloc(bench_results,
+						sizeof(*results) * (bench_num_results + 1));
+					if (results) {
+						bench_results = results;
+						bench_results[bench_num_results++] = r;
+					}
+				}
+			}
+			free(trees);
+			free(bldgs);
+		}
+		ac_jobs_shutdown();
+	}
+
+	if (out != stdout)
+		fclose(out);
+	free(bench_results);
+	free(bench_refs);
+	return ok ? 0 : 1;
+}
@@ -29,6 +29,7 @@ int main(int argc, char **argv) {
 
 	SDL_WM_SetCaption("Generating heightmap...", "Terrain viewer");
 	gen_terrain(0xDEADBEEF);
+	gen_save_world();
 	// load the heightmap into a surface
 	SDL_Surface *bmp = SDL_CreateRGBSurfaceFrom(
 		gen_heightmap, HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, 8,